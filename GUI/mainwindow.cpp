@@ -79,51 +79,68 @@ void MainWindow::changeEvent(QEvent *e)
     }
 }
 /**
- * @brief Connection to the Sink mote using USB. \n
- * Once the mote is inserted it is detected and then clicked on open one can see data on the window.*/
+ * @brief Connection to a Sink mote using USB. \n
+ * Once the mote is inserted it is detected and then clicked on open one can see data on the window.
+ * Clicking open again with another interface selected adds the next sink.
+ * Commands go to the first sink.*/
 void MainWindow::on_pushButton_open_clicked()
 {
-    port.setQueryMode(QextSerialPort::EventDriven);
-    port.setPortName("/dev/" + ui->comboBox_Interface->currentText());
-    port.setBaudRate(BAUD115200);
-    port.setFlowControl(FLOW_OFF);
-    port.setParity(PAR_NONE);
-    port.setDataBits(DATA_8);
-    port.setStopBits(STOP_1);
-    port.open(QIODevice::ReadWrite);
+    QString portname = "/dev/" + ui->comboBox_Interface->currentText();
+    for (int i = 0; i < ports.size(); i++) {
+        if (ports.at(i)->portName() == portname) {
+            error.setText("Port already open!");
+            error.show();
+            return;
+        }
+    }
+
+    QextSerialPort *port = new QextSerialPort(portname, QextSerialPort::EventDriven, this);
+    port->setBaudRate(BAUD115200);
+    port->setFlowControl(FLOW_OFF);
+    port->setParity(PAR_NONE);
+    port->setDataBits(DATA_8);
+    port->setStopBits(STOP_1);
+    port->open(QIODevice::ReadWrite);
 
     /**
      * @brief To start the Communication click on open.*/
 
-    if (!port.isOpen())
+    if (!port->isOpen())
     {
+        delete port;
         error.setText("Unable to open port!");
         error.show();
         return;
     }
 
     // UART
-    QString portname = "/dev/" + ui->comboBox_Interface->currentText();
-    uart->open(portname);
-    if (!uart->isOpen())
-    {
-        error.setText("Unable to open UART port!");
-        error.show();
-        return;
+    if (ports.isEmpty()) {
+        uart->open(portname);
+        if (!uart->isOpen())
+        {
+            delete port;
+            error.setText("Unable to open UART port!");
+            error.show();
+            return;
+        }
     }
 
-    QObject::connect(&port, SIGNAL(readyRead()), this, SLOT(receive()));
+    ports.append(port);
+    QObject::connect(port, SIGNAL(readyRead()), this, SLOT(receive()));
 
     ui->pushButton_close->setEnabled(true);
-    ui->pushButton_open->setEnabled(false);
-    ui->comboBox_Interface->setEnabled(false);
 }
 
 /**
- * @brief To close the Communication click on close.*/
+ * @brief To close the Communication click on close. Closes the ports of all sinks.*/
 void MainWindow::on_pushButton_close_clicked()
 {
-    if (port.isOpen())port.close();
+    for (int i = 0; i < ports.size(); i++) {
+        if (ports.at(i)->isOpen()) ports.at(i)->close();
+        delete ports.at(i);
+    }
+    ports.clear();
+    lines.clear();
     if (uart->isOpen()) uart->close();
     ui->pushButton_close->setEnabled(false);
     ui->pushButton_open->setEnabled(true);
@@ -146,9 +163,13 @@ void MainWindow::uart_send(QByteArray data) {
 
 void MainWindow::receive(){
 
-    static QString str;
+    QextSerialPort *port = qobject_cast<QextSerialPort *>(sender());
+    if (port == nullptr) {
+        return;
+    }
+    QString &str = lines[port];
     char ch;
-    while (port.getChar(&ch)){
+    while (port->getChar(&ch)){
         str.append(ch);
         /**
          * @brief End of line, start decoding */
@@ -158,138 +179,72 @@ void MainWindow::receive(){
             ui->textEdit_Status->ensureCursorVisible();
 
 
-            if(str.contains("DataType:")){
+            if(str.contains("DataType:") && !isDuplicateSample(str)){
                 QStringList list = str.split(QRegExp("\\s"));
                 qDebug() << "Received from Serial Link: " << str;
 
                   //SENSORS
                 if(!list.isEmpty()){
                     qDebug() << "List size " << list.size();
-                    double soil;
                     int i=0;
                     qDebug() << "List value "<< i <<" "<< list.at(i);
-                    switch(list.at(i+1).toInt()){
-                    case 2:
-                        /**
-                         * @brief Details for calculating the temperature */
-                        double temperature;
-                        temperature = list.at(i+3).toDouble();
-                        /**
-                         * @brief Adjust the temperature to Degrees */
-                       temperature = temperature/1000;
-                       printf("%f\n",temperature);
-                       if(temperature < 5){
-                           QPixmap image(":images/cold.jpg");
-                           pop_up.setText("Too cold for your plants");
-                           pop_up.setIconPixmap(image);
-                           pop_up.show();
-                       } else if(temperature > 30){
-                           QPixmap image(":images/hot.png");
-                           pop_up.setText("Too hot for your plants");
-                           pop_up.setIconPixmap(image);
-                           pop_up.show();
-                       } else {
-                           pop_up.hide();
-                       }
-                       /**
-                        * @brief Debugging the temperature and displaying on the QLCD */
-                       qDebug() << "Var temperature " << QString::number(temperature);
-                       ui->value_temperature->display(temperature);
-                        break;
-
-                    case 4:
-                        soil = list.at(i+3).toDouble();
-                        printf("%f\n",soil);
-                        if(soil < 10){
-                            QPixmap image(":images/dry_plant.jpg");
-                            pop_up.setText("Too dry for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else if(soil > 80){
-                            QPixmap image(":images/DrowningPlant.png");
-                            pop_up.setText("Too wet for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else {
-                            pop_up.hide();
-                        }
-                        /**
-                         * @brief Debugging the Soil Miosture and displaying on the QLCD */
-                        qDebug() << "Var soil " << QString::number(soil);
-                        ui->value_soil->display(soil);
-                        break;
-                    case 6:
-                        soil = list.at(i+3).toDouble();
-                        printf("%f\n",soil);
-                        if(soil < 10){
-                            QPixmap image(":images/dry_plant.jpg");
-                            pop_up.setText("Too dry for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else if(soil > 80){
-                            QPixmap image(":images/DrowningPlant.png");
-                            pop_up.setText("Too wet for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else {
-                            pop_up.hide();
+                    /**
+                     * @brief The sink reports how many seconds ago the value was sampled.
+                     * Without it the arrival time is the best guess we have. */
+                    int delay = -1;
+                    qint64 time = -1;
+                    for (int j = 0; j < list.size() - 1; j++) {
+                        if (list.at(j) == "Delay:") {
+                            delay = list.at(j+1).toInt();
+                        } else if (list.at(j) == "Time:") {
+                            time = list.at(j+1).toLongLong();
                         }
-                        /**
-                         * @brief Debugging the Soil Miosture and displaying on the QLCD */
-                        qDebug() << "Var soil " << QString::number(soil);
-                        ui->value_soil->display(soil);
-                        break;
-                    case 8:
-                        double light;
-                        light = list.at(i+3).toDouble();
-                        printf("%f\n",light);
-                        if(light < 40){
-                            QPixmap image(":images/night_time.jpg");
-                            pop_up.setText("Too dark for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else {
-                            pop_up.hide();
-                        }
-                        /**
-                         * @brief Debugging the light and displaying on the QLCD */
-                        qDebug() << "Var light " << QString::number(light);
-                        ui->value_light->display(light);
-                        break;
-                    case 10:
-                        double pH;
-                        pH = list.at(i+3).toDouble();
-                        printf("%f\n",pH);
-                        if(pH < 3){
-                            QPixmap image(":images/acidic.jpg");
-                            pop_up.setText("Too acidic for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else if(pH > 9){
-                            QPixmap image(":images/basic.jpg");
-                            pop_up.setText("Too basic for your plants");
-                            pop_up.setIconPixmap(image);
-                            pop_up.show();
-                        } else {
-                            pop_up.hide();
+                    }
+                    QDateTime sampleTime = QDateTime::currentDateTime().addSecs(delay > 0 ? -delay : 0);
+                    double sample_value = list.at(i+3).toDouble();
+                    if (list.at(i+1).toInt() == 2) {
+                        sample_value = sample_value/1000;
+                    }
+                    recordSample(list.at(i+1).toInt(), sample_value, sampleTime, delay);
+                    // Readings can arrive out of order, the display keeps the newest
+                    if (isNewerSample(list.at(i+1).toInt(), time)) {
+                        showSample(list.at(i+1).toInt(), list.at(i+3).toDouble());
+                    }
+                }
+            }
+            // Statistics of a sensor over a window, the sink sends them at a fixed rate
+            else if(str.contains("Summary:")){
+                QStringList list = str.split(QRegExp("\\s"), QString::SkipEmptyParts);
+                QMap<QString, QString> fields;
+                for (int j = 0; j < list.size() - 1; j += 2) {
+                    fields[list.at(j)] = list.at(j+1);
+                }
+                if (fields.contains("Summary:") && fields.contains("Window:")) {
+                    recordSummary(fields);
+                    /**
+                     * @brief Every window and every summary repeats the last reading until a new one
+                     * arrives. It is only recorded and shown once, and only if no newer one is shown. */
+                    int type = fields["Summary:"].toInt();
+                    qint64 time = fields.value("Time:", "-1").toLongLong();
+                    if (time >= 0 && !isDuplicateSample(type, time)) {
+                        int age = fields["Age:"].toInt();
+                        recordSample(type, fields["Last:"].toDouble()/(type == 2 ? 1000 : 1),
+                                     QDateTime::currentDateTime().addSecs(-age), -1);
+                        if (isNewerSample(type, time)) {
+                            showSample(type, fields["Last:"].toDouble());
                         }
-                        /**
-                         * @brief Debugging the pH Level and displaying on the QLCD */
-                        qDebug() << "Var pH " << QString::number(pH);
-                        ui->value_pH->display(pH);
-                        break;
-                    case 12:
-                        double humidity;
-                        humidity = list.at(i+3).toDouble();
-                        printf("%f\n",humidity);
-                        /**
-                         * @brief Debugging the humidity and displaying on the QLCD */
-                        qDebug() << "Var Humidity " << QString::number(humidity);
-                        ui->value_humidity->display(humidity);
-                        break;
                     }
                 }
             }
+            // Delivery of the data packets of a sensor, in total or over one path
+            else if(str.contains("Delivery:") || str.contains("DeliveryPath:")){
+                QStringList list = str.split(QRegExp("\\s"), QString::SkipEmptyParts);
+                QMap<QString, QString> fields;
+                for (int j = 0; j < list.size() - 1; j += 2) {
+                    fields[list.at(j)] = list.at(j+1);
+                }
+                recordDelivery(fields);
+            }
             // NETWORK TOPOLOGY
             // New Link
             else if(str.contains("NewLink:")){
@@ -376,7 +331,7 @@ void MainWindow::receive(){
                     }
                 }
             }
-            this->repaint();    // Update content of window immediately
+            this->update();    // Repainted once the received lines are handled
             str.clear();
         }
     }
@@ -415,6 +370,397 @@ void MainWindow::createDockWindows()
     dock->setWidget(widget);
     addDockWidget(Qt::RightDockWidgetArea, dock);
 
+    QDockWidget *sample_dock = new QDockWidget(tr("Samples"), this);
+    sample_dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+    samples = new QTableWidget(0, 4, sample_dock);
+    samples->setHorizontalHeaderLabels(QStringList() << tr("Sample time") << tr("Sensor") << tr("Value") << tr("Delay (s)"));
+    samples->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    samples->horizontalHeader()->setStretchLastSection(true);
+    sample_dock->setWidget(samples);
+    addDockWidget(Qt::BottomDockWidgetArea, sample_dock);
+
+    QDockWidget *plot_dock = new QDockWidget(tr("Sample plot"), this);
+    plot_dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+    samplePlot = new SamplePlot(plot_dock);
+    plot_dock->setWidget(samplePlot);
+    addDockWidget(Qt::BottomDockWidgetArea, plot_dock);
+
+    QDockWidget *summary_dock = new QDockWidget(tr("Summaries"), this);
+    summary_dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+    summaries = new QTableWidget(0, 9, summary_dock);
+    summaries->setHorizontalHeaderLabels(QStringList() << tr("Sensor") << tr("Window (s)") << tr("Count") << tr("Min")
+                                         << tr("Max") << tr("Mean") << tr("Last") << tr("Age (s)") << tr("Sink"));
+    summaries->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    summaries->horizontalHeader()->setStretchLastSection(true);
+    summary_dock->setWidget(summaries);
+    addDockWidget(Qt::BottomDockWidgetArea, summary_dock);
+
+    QDockWidget *delivery_dock = new QDockWidget(tr("Delivery"), this);
+    delivery_dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+    delivery = new QTableWidget(0, 8, delivery_dock);
+    delivery->setHorizontalHeaderLabels(QStringList() << tr("Sensor") << tr("Sink") << tr("Path") << tr("Received") << tr("Lost")
+                                        << tr("Duplicates") << tr("Reordered") << tr("PDR (%)"));
+    delivery->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    delivery->horizontalHeader()->setStretchLastSection(true);
+    delivery_dock->setWidget(delivery);
+    addDockWidget(Qt::BottomDockWidgetArea, delivery_dock);
+}
+
+/*!
+ * \brief MainWindow::showSample: Shows the latest value of a sensor on its display and
+ * warns the user if it is out of the range the plants like.
+ */
+void MainWindow::showSample(int type, double value)
+{
+    double soil;
+    switch(type){
+    case 2:
+        /**
+         * @brief Details for calculating the temperature */
+        double temperature;
+        temperature = value;
+        /**
+         * @brief Adjust the temperature to Degrees */
+       temperature = temperature/1000;
+       printf("%f\n",temperature);
+       if(temperature < 5){
+           QPixmap image(":images/cold.jpg");
+           pop_up.setText("Too cold for your plants");
+           pop_up.setIconPixmap(image);
+           pop_up.show();
+       } else if(temperature > 30){
+           QPixmap image(":images/hot.png");
+           pop_up.setText("Too hot for your plants");
+           pop_up.setIconPixmap(image);
+           pop_up.show();
+       } else {
+           pop_up.hide();
+       }
+       /**
+        * @brief Debugging the temperature and displaying on the QLCD */
+       qDebug() << "Var temperature " << QString::number(temperature);
+       ui->value_temperature->display(temperature);
+        break;
+
+    case 4:
+        soil = value;
+        printf("%f\n",soil);
+        if(soil < 10){
+            QPixmap image(":images/dry_plant.jpg");
+            pop_up.setText("Too dry for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else if(soil > 80){
+            QPixmap image(":images/DrowningPlant.png");
+            pop_up.setText("Too wet for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else {
+            pop_up.hide();
+        }
+        /**
+         * @brief Debugging the Soil Miosture and displaying on the QLCD */
+        qDebug() << "Var soil " << QString::number(soil);
+        ui->value_soil->display(soil);
+        break;
+    case 6:
+        soil = value;
+        printf("%f\n",soil);
+        if(soil < 10){
+            QPixmap image(":images/dry_plant.jpg");
+            pop_up.setText("Too dry for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else if(soil > 80){
+            QPixmap image(":images/DrowningPlant.png");
+            pop_up.setText("Too wet for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else {
+            pop_up.hide();
+        }
+        /**
+         * @brief Debugging the Soil Miosture and displaying on the QLCD */
+        qDebug() << "Var soil " << QString::number(soil);
+        ui->value_soil->display(soil);
+        break;
+    case 8:
+        double light;
+        light = value;
+        printf("%f\n",light);
+        if(light < 40){
+            QPixmap image(":images/night_time.jpg");
+            pop_up.setText("Too dark for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else {
+            pop_up.hide();
+        }
+        /**
+         * @brief Debugging the light and displaying on the QLCD */
+        qDebug() << "Var light " << QString::number(light);
+        ui->value_light->display(light);
+        break;
+    case 10:
+        double pH;
+        pH = value;
+        printf("%f\n",pH);
+        if(pH < 3){
+            QPixmap image(":images/acidic.jpg");
+            pop_up.setText("Too acidic for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else if(pH > 9){
+            QPixmap image(":images/basic.jpg");
+            pop_up.setText("Too basic for your plants");
+            pop_up.setIconPixmap(image);
+            pop_up.show();
+        } else {
+            pop_up.hide();
+        }
+        /**
+         * @brief Debugging the pH Level and displaying on the QLCD */
+        qDebug() << "Var pH " << QString::number(pH);
+        ui->value_pH->display(pH);
+        break;
+    case 12:
+        double humidity;
+        humidity = value;
+        printf("%f\n",humidity);
+        /**
+         * @brief Debugging the humidity and displaying on the QLCD */
+        qDebug() << "Var Humidity " << QString::number(humidity);
+        ui->value_humidity->display(humidity);
+        break;
+    }
+}
+
+/*!
+ * \brief MainWindow::sensorName: Name of the sensor of a data type.
+ */
+QString MainWindow::sensorName(int type) const
+{
+    switch (type) {
+    case 2: return tr("Temperature");
+    case 4: return tr("Soil moisture 1");
+    case 6: return tr("Soil moisture 2");
+    case 8: return tr("Light");
+    case 10: return tr("pH");
+    case 12: return tr("Humidity");
+    default: return QString::number(type);
+    }
+}
+
+/*!
+ * \brief MainWindow::recordSummary: Every sink, sensor and window has one row, updated in place.
+ * Every sink only counts the readings that arrived at it.
+ */
+void MainWindow::recordSummary(const QMap<QString, QString> &fields)
+{
+    int type = fields["Summary:"].toInt();
+    int window = fields["Window:"].toInt();
+    QString sink = fields.value("Sink:", tr("unknown"));
+    double scale = type == 2 ? 1000 : 1;
+    int row = 0;
+    while (row < summaries->rowCount()
+           && !(summaries->item(row, 0)->data(Qt::UserRole).toInt() == type
+                && summaries->item(row, 1)->text().toInt() == window
+                && summaries->item(row, 8)->text() == sink)) {
+        row++;
+    }
+    if (row == summaries->rowCount()) {
+        summaries->insertRow(row);
+    }
+    QTableWidgetItem *sensor_item = new QTableWidgetItem(sensorName(type));
+    sensor_item->setData(Qt::UserRole, type);
+    summaries->setItem(row, 0, sensor_item);
+    summaries->setItem(row, 1, new QTableWidgetItem(QString::number(window)));
+    summaries->setItem(row, 2, new QTableWidgetItem(fields["Count:"]));
+    summaries->setItem(row, 3, new QTableWidgetItem(QString::number(fields["Min:"].toDouble()/scale)));
+    summaries->setItem(row, 4, new QTableWidgetItem(QString::number(fields["Max:"].toDouble()/scale)));
+    summaries->setItem(row, 5, new QTableWidgetItem(QString::number(fields["Mean:"].toDouble()/scale)));
+    summaries->setItem(row, 6, new QTableWidgetItem(QString::number(fields["Last:"].toDouble()/scale)));
+    summaries->setItem(row, 7, new QTableWidgetItem(fields["Age:"]));
+    summaries->setItem(row, 8, new QTableWidgetItem(sink));
+}
+
+/*!
+ * \brief MainWindow::recordDelivery: Every sink and sensor has one row for all its packets and one
+ * per path they took, updated in place. Losses can't be told per path.
+ * Every sink counts the packets that reached another sink as lost, so every sensor also has a row
+ * for all sinks, with the packets of the sinks added up.
+ */
+void MainWindow::recordDelivery(const QMap<QString, QString> &fields)
+{
+    int type = fields.contains("Delivery:") ? fields["Delivery:"].toInt() : fields["DeliveryPath:"].toInt();
+    QString sink = fields.value("Sink:", tr("unknown"));
+    setDeliveryRow(type, sink, fields.value("Path:", tr("all")), fields["Received:"], fields.value("Lost:"),
+                   fields["Duplicates:"], fields["Reordered:"], fields.value("PDR:"));
+    if (!fields.contains("Delivery:")) {
+        return;
+    }
+
+    DeliveryCount &count = deliveryCounts[type][sink];
+    count.expected = fields["Expected:"].toLongLong();
+    count.received = fields["Received:"].toLongLong();
+    count.duplicates = fields["Duplicates:"].toLongLong();
+    count.reordered = fields["Reordered:"].toLongLong();
+
+    /**
+     * @brief The sensor numbers its packets, so the sink that saw the most expects the most.
+     * A packet that reached two sinks counts at both, so no more are received than expected. */
+    DeliveryCount total = {0, 0, 0, 0};
+    foreach (const DeliveryCount &c, deliveryCounts[type]) {
+        total.expected = qMax(total.expected, c.expected);
+        total.received += c.received;
+        total.duplicates += c.duplicates;
+        total.reordered += c.reordered;
+    }
+    total.received = qMin(total.received, total.expected);
+    double pdr = total.expected > 0 ? 100.0 * total.received / total.expected : 0;
+    setDeliveryRow(type, tr("all"), tr("all"), QString::number(total.received),
+                   QString::number(total.expected - total.received), QString::number(total.duplicates),
+                   QString::number(total.reordered), QString::number(pdr, 'f', 1));
+}
+
+/*!
+ * \brief MainWindow::setDeliveryRow: Updates the row of a sensor, sink and path, or adds it.
+ */
+void MainWindow::setDeliveryRow(int type, const QString &sink, const QString &path, const QString &received,
+                                const QString &lost, const QString &duplicates, const QString &reordered,
+                                const QString &pdr)
+{
+    int row = 0;
+    while (row < delivery->rowCount()
+           && !(delivery->item(row, 0)->data(Qt::UserRole).toInt() == type
+                && delivery->item(row, 1)->text() == sink
+                && delivery->item(row, 2)->text() == path)) {
+        row++;
+    }
+    if (row == delivery->rowCount()) {
+        delivery->insertRow(row);
+    }
+    QTableWidgetItem *sensor_item = new QTableWidgetItem(sensorName(type));
+    sensor_item->setData(Qt::UserRole, type);
+    delivery->setItem(row, 0, sensor_item);
+    delivery->setItem(row, 1, new QTableWidgetItem(sink));
+    delivery->setItem(row, 2, new QTableWidgetItem(path));
+    delivery->setItem(row, 3, new QTableWidgetItem(received));
+    delivery->setItem(row, 4, new QTableWidgetItem(lost));
+    delivery->setItem(row, 5, new QTableWidgetItem(duplicates));
+    delivery->setItem(row, 6, new QTableWidgetItem(reordered));
+    delivery->setItem(row, 7, new QTableWidgetItem(pdr));
+}
+
+/*!
+ * \brief MainWindow::recordSample: Samples can arrive out of order after multi-hop forwarding,
+ * so each one is inserted at the position of its sample time. Only the newest rows are kept.
+ * It is also added to the plot over sample time.
+ */
+void MainWindow::recordSample(int type, double value, const QDateTime &sampleTime, int delay)
+{
+    static const int max_rows = 500;
+    QString sensor = sensorName(type);
+
+    // Newest samples on top
+    int row = 0;
+    while (row < samples->rowCount()
+           && samples->item(row, 0)->data(Qt::UserRole).toDateTime() > sampleTime) {
+        row++;
+    }
+    samples->insertRow(row);
+    QTableWidgetItem *time_item = new QTableWidgetItem(sampleTime.toString("yyyy-MM-dd hh:mm:ss"));
+    time_item->setData(Qt::UserRole, sampleTime);
+    samples->setItem(row, 0, time_item);
+    samples->setItem(row, 1, new QTableWidgetItem(sensor));
+    samples->setItem(row, 2, new QTableWidgetItem(QString::number(value)));
+    samples->setItem(row, 3, new QTableWidgetItem(delay >= 0 ? QString::number(delay) : tr("unknown")));
+
+    if (samples->rowCount() > max_rows) {
+        samples->removeRow(samples->rowCount() - 1);
+    }
+    samplePlot->addSample(type, sensor, value, sampleTime);
+}
+
+// SAMPLE PLOT
+SamplePlot::SamplePlot(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumSize(400, 200);
+    setWindowTitle(tr("Sample plot"));
+}
+
+void SamplePlot::addSample(int type, const QString &name, double value, const QDateTime &sampleTime)
+{
+    static const int max_samples = 200;
+    QVector<QPair<QDateTime, double> > &samples = series[type];
+
+    // Samples can arrive out of order, the line follows the sample time
+    int i = samples.size();
+    while (i > 0 && samples.at(i-1).first > sampleTime) {
+        i--;
+    }
+    samples.insert(i, qMakePair(sampleTime, value));
+    if (samples.size() > max_samples) {
+        samples.remove(0);
+    }
+    names[type] = name;
+    update();
+}
+
+void SamplePlot::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    static const Qt::GlobalColor colors[] = {Qt::red, Qt::blue, Qt::darkGreen, Qt::magenta, Qt::darkYellow, Qt::darkCyan};
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.fillRect(rect(), Qt::white);
+    QRectF area = QRectF(rect()).adjusted(10, 10, -10, -30);
+    painter.setPen(Qt::darkGray);
+    painter.drawRect(area);
+    if (series.isEmpty()) {
+        return;
+    }
+
+    // One time axis for all sensors
+    QDateTime first, last;
+    for (auto it = series.constBegin(); it != series.constEnd(); ++it) {
+        if (it.value().isEmpty())
+            continue;
+        if (!first.isValid() || it.value().first().first < first)
+            first = it.value().first().first;
+        if (!last.isValid() || it.value().last().first > last)
+            last = it.value().last().first;
+    }
+    qint64 span = qMax<qint64>(first.msecsTo(last), 1);
+    painter.drawText(QRectF(area.left(), area.bottom() + 5, area.width(), 20), Qt::AlignLeft,
+                     first.toString("hh:mm:ss"));
+    painter.drawText(QRectF(area.left(), area.bottom() + 5, area.width(), 20), Qt::AlignRight,
+                     last.toString("hh:mm:ss"));
+
+    int n = 0;
+    for (auto it = series.constBegin(); it != series.constEnd(); ++it, ++n) {
+        const QVector<QPair<QDateTime, double> > &samples = it.value();
+        if (samples.isEmpty())
+            continue;
+        double min = samples.first().second, max = min;
+        for (const auto &sample : samples) {
+            min = qMin(min, sample.second);
+            max = qMax(max, sample.second);
+        }
+        double range = max > min ? max - min : 1;
+
+        QPolygonF line;
+        for (const auto &sample : samples) {
+            line << QPointF(area.left() + area.width() * first.msecsTo(sample.first) / span,
+                            area.bottom() - area.height() * (sample.second - min) / range);
+        }
+        painter.setPen(QPen(colors[n % 6], 2));
+        painter.drawPolyline(line);
+        painter.drawText(QPointF(area.left() + 5, area.top() + 15 * (n + 1)),
+                         tr("%1: %2 to %3").arg(names[it.key()]).arg(min).arg(max));
+    }
 }
 
 GraphWidget::GraphWidget(QWidget *parent)
@@ -701,3 +1047,64 @@ void Edge::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
 
 
 
+
+/*!
+ * \brief MainWindow::isDuplicateSample: With several sinks a resent sample can arrive twice,
+ * once at every sink. All sinks share the network time, so the copies carry the same sample
+ * time give or take a second. Samples without a time can't be told apart and are always kept.
+ */
+bool MainWindow::isDuplicateSample(const QString &line)
+{
+    QStringList list = line.split(QRegExp("\\s"), QString::SkipEmptyParts);
+    int type = -1;
+    qint64 time = -1;
+    for (int j = 0; j < list.size() - 1; j++) {
+        if (list.at(j) == "DataType:") {
+            type = list.at(j+1).toInt();
+        } else if (list.at(j) == "Time:") {
+            time = list.at(j+1).toLongLong();
+        }
+    }
+    if (type < 0 || time < 0) {
+        return false;
+    }
+    if (isDuplicateSample(type, time)) {
+        qDebug() << "Dropping duplicate sample: " << line;
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief MainWindow::isDuplicateSample: Remembers the sample times of the last samples of every sensor.
+ */
+bool MainWindow::isDuplicateSample(int type, qint64 time)
+{
+    static const int max_samples = 32;
+    QList<qint64> &times = recentSamples[type];
+    for (int j = 0; j < times.size(); j++) {
+        if (qAbs(times.at(j) - time) <= 1) {
+            return true;
+        }
+    }
+    times.append(time);
+    if (times.size() > max_samples) {
+        times.removeFirst();
+    }
+    return false;
+}
+
+/*!
+ * \brief MainWindow::isNewerSample: Samples without a time are taken as the newest, like before.
+ */
+bool MainWindow::isNewerSample(int type, qint64 time)
+{
+    if (time < 0) {
+        return true;
+    }
+    if (shownSamples.contains(type) && time <= shownSamples[type]) {
+        return false;
+    }
+    shownSamples[type] = time;
+    return true;
+}
@@ -10,6 +10,8 @@
 #include <QGraphicsView>
 #include <QGraphicsItem>
 #include <QVector>
+#include <QDateTime>
+#include <QTableWidget>
 #include "qextserialport.h"
 #include "qextserialenumerator.h"
 #include <QtSql>
@@ -23,6 +25,7 @@ namespace Ui {
 }
 
 class GraphWidget;
+class SamplePlot;
 class Node;
 class Edge;
 
@@ -52,9 +55,21 @@ private:
      */
     Ui::MainWindow *ui;
     /*!
-     * \brief Used for communication with the Mote via UART
+     * \brief Serial ports of the sink motes, one per sink
      */
-    QextSerialPort port;
+    QList<QextSerialPort *> ports;
+    /*!
+     * \brief Partly received line of every sink port
+     */
+    QMap<QextSerialPort *, QString> lines;
+    /*!
+     * \brief Sample times (network seconds) recently received per data type, to drop duplicates
+     */
+    QMap<int, QList<qint64> > recentSamples;
+    /*!
+     * \brief Sample time (network seconds) of the value shown per data type
+     */
+    QMap<int, qint64> shownSamples;
     /*!
      * \brief Error message that pops up when no ports avialable
      */
@@ -83,10 +98,98 @@ private:
      * \brief Holds edges of the last path taken by a data packet (data packet from a sensor mote)
      */
     std::vector<Edge *> last_path;
+    /*!
+     * \brief Table of received sensor samples, ordered by the time they were sampled
+     */
+    QTableWidget *samples;
+    /*!
+     * \brief Plot of the received sensor samples over the time they were sampled
+     */
+    SamplePlot *samplePlot;
+    /*!
+     * \brief Table of the statistics the sinks send per sensor and window
+     */
+    QTableWidget *summaries;
+    /*!
+     * \brief Table of the delivery of the data packets of every sensor, as the sinks count it
+     */
+    QTableWidget *delivery;
+    /*!
+     * \brief Packets of a sensor a sink counted, from its last Delivery line
+     */
+    struct DeliveryCount {
+        qint64 expected;
+        qint64 received;
+        qint64 duplicates;
+        qint64 reordered;
+    };
+    /*!
+     * \brief Packets counted per data type and sink, merged into the row of all sinks
+     */
+    QMap<int, QMap<QString, DeliveryCount> > deliveryCounts;
     /*!
      * \brief Adds the graph widget of the network topology to the MainWindow object
      */
     void createDockWindows();
+    /*!
+     * \brief Adds a sample to the sample table, keeping the table ordered by sample time
+     * \param type Data type of the sample (node id of the sensor mote)
+     * \param value Converted sensor value
+     * \param sampleTime Time the sample was taken on the sensor mote
+     * \param delay Seconds the sample spent in the network, -1 if unknown
+     */
+    void recordSample(int type, double value, const QDateTime &sampleTime, int delay);
+    /*!
+     * \brief Updates the row of a sensor and window in the summary table
+     * \param fields Values of a Summary line from a sink, by their key
+     */
+    void recordSummary(const QMap<QString, QString> &fields);
+    /*!
+     * \brief Updates the row of a sink and sensor, or of a path its packets took, in the delivery table
+     * \param fields Values of a Delivery or DeliveryPath line from a sink, by their key
+     */
+    void recordDelivery(const QMap<QString, QString> &fields);
+    /*!
+     * \brief Updates a row of the delivery table, or adds it
+     * \param type Data type (node id of the sensor mote)
+     * \param sink Node id of the sink that counted, or all
+     * \param path Hops of the path, or all
+     */
+    void setDeliveryRow(int type, const QString &sink, const QString &path, const QString &received,
+                        const QString &lost, const QString &duplicates, const QString &reordered,
+                        const QString &pdr);
+    /*!
+     * \brief Shows a sensor value on its display
+     * \param type Data type of the sample (node id of the sensor mote)
+     * \param value Sensor value as the sink reports it
+     */
+    void showSample(int type, double value);
+    /*!
+     * \brief Name of the sensor of a data type
+     * \param type Data type (node id of the sensor mote)
+     */
+    QString sensorName(int type) const;
+    /*!
+     * \brief Checks whether a sample was already received through another sink.
+     * A resent sample may arrive at two sinks, both report the same sample time.
+     * \param line DataType line from a sink
+     * \return True if the sample was seen before
+     */
+    bool isDuplicateSample(const QString &line);
+    /*!
+     * \brief Checks whether a sample was already received, through another sink or a summary.
+     * \param type Data type of the sample (node id of the sensor mote)
+     * \param time Sample time in network seconds
+     * \return True if the sample was seen before
+     */
+    bool isDuplicateSample(int type, qint64 time);
+    /*!
+     * \brief Checks whether a sample is newer than the value shown for its sensor, and remembers it if so.
+     * \param type Data type of the sample (node id of the sensor mote)
+     * \param time Sample time in network seconds, -1 if unknown
+     * \return True if the sample should be shown
+     */
+    bool isNewerSample(int type, qint64 time);
 
 private slots:
     /*!
@@ -151,6 +254,44 @@ private:
     Node *centerNode;
 };
 
+//! SamplePlot
+/*!
+ * \brief The SamplePlot class: Plots the samples of every sensor over the time they were sampled.
+ * The sensors have different units, so every line is scaled to the range of its own samples.
+ */
+class SamplePlot : public QWidget
+{
+public:
+    //! Constructor
+    SamplePlot(QWidget *parent = nullptr);
+
+    /*!
+     * \brief Adds a sample at the position of its sample time, only the newest ones are kept
+     * \param type Data type of the sample (node id of the sensor mote)
+     * \param name Name of the sensor, for the legend
+     * \param value Converted sensor value
+     * \param sampleTime Time the sample was taken on the sensor mote
+     */
+    void addSample(int type, const QString &name, double value, const QDateTime &sampleTime);
+
+protected:
+    /*!
+     * \brief Draws the time axis, a line per sensor and the legend
+     * \param event The event object
+     */
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    /*!
+     * \brief Samples per data type, ordered by sample time
+     */
+    QMap<int, QVector<QPair<QDateTime, double> > > series;
+    /*!
+     * \brief Name of the sensor per data type
+     */
+    QMap<int, QString> names;
+};
+
 class Node : public QGraphicsItem
 {
 public:
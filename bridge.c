@@ -0,0 +1,7 @@
+/** @file bridge.c
+ * @brief Firmware image of a bridge. Floods LSAs and forwards data, without sensor code.
+ * See NODE_ROLE in project-conf.h.*/
+
+#define NODE_ROLE NODE_ROLE_BRIDGE
+
+#include "routing.c"
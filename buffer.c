@@ -1,52 +1,175 @@
+
 #include "buffer.h"
 #include <stdio.h>
 
-uint8_t BufferIn(Buffer *buffer, struct lsa packet, struct timer packet_timer, bool forward, bool reply_to_send_lsdb_req, linkaddr_t dst)
+MEMB(buffer_pool, BufferEntry, BUFFER_POOL_SIZE);
+
+static const uint8_t buffer_weights[BUFFER_CLASSES] = BUFFER_WEIGHTS;
+static const uint8_t buffer_drop_policies[BUFFER_CLASSES] = BUFFER_DROP_POLICIES;
+static const uint8_t buffer_pool_reserved[BUFFER_CLASSES] = BUFFER_POOL_RESERVED;
+
+// true if the pool has a packet for the class, without the ones still reserved for others
+static bool BufferPoolHasRoom(Buffer *buffer, uint8_t class)
 {
-	// for debug:
-	printf("BufferIn: write: %d, read: %d\r\n", buffer->write, buffer->read);
+	uint8_t c;
+	int reserved = 0;
 
-	// check if buffer is full
-	if ( ( buffer->write + 1 == buffer->read ) ||
-			( buffer->read == 0 && buffer->write + 1 == BUFFER_SIZE ) )
-		return BUFFER_FAIL;
+	for (c = 0; c < BUFFER_CLASSES; c++) {
+		if (c != class && buffer->taken[c] < buffer_pool_reserved[c])
+			reserved += buffer_pool_reserved[c] - buffer->taken[c];
+	}
+	return memb_numfree(&buffer_pool) > reserved;
+}
 
-	// store packet and timer in the buffer
-	buffer->packets[buffer->write] = packet;
-	buffer->timers[buffer->write] = packet_timer;
-	buffer->forward[buffer->write] = forward;
-	buffer->reply_to_send_lsdb_req[buffer->write] = reply_to_send_lsdb_req;
-	buffer->dst[buffer->write] = dst;
+static bool BufferReady(Buffer *buffer, uint8_t class)
+{
+	return buffer->read[class] != buffer->write[class] &&
+			timer_expired(&buffer->queues[class][buffer->read[class]]->timer);
+}
 
-	buffer->write++;
-	// if reached end of buffer set write pointer to 0
-	if (buffer->write >= BUFFER_SIZE)
-		buffer->write = 0;
+static BufferEntry *BufferPop(Buffer *buffer, uint8_t class)
+{
+	BufferEntry *entry = buffer->queues[class][buffer->read[class]];
 
-	return BUFFER_SUCCESS;
+	buffer->read[class]++;
+	// if reached end of buffer set read pointer to 0
+	if (buffer->read[class] >= BUFFER_SIZE)
+		buffer->read[class] = 0;
+	return entry;
 }
 
-uint8_t BufferOut(Buffer *buffer, struct lsa *packet, struct timer *packet_timer, bool *forward, bool *reply_to_send_lsdb_req, linkaddr_t *dst)
+void BufferInit(Buffer *buffer)
 {
+	uint8_t class;
+
+	memb_init(&buffer_pool);
+	for (class = 0; class < BUFFER_CLASSES; class++) {
+		buffer->read[class] = 0;
+		buffer->write[class] = 0;
+		buffer->credit[class] = buffer_weights[class];
+		buffer->dropped[class] = 0;
+		buffer->taken[class] = 0;
+	}
+}
+
+BufferEntry *BufferAlloc(Buffer *buffer, uint8_t class)
+{
+	BufferEntry *entry;
+
 	// for debug:
-	printf("BufferOut: write: %d, read: %d\r\n", buffer->write, buffer->read);
+	printf("BufferAlloc: class: %d, write: %d, read: %d\r\n", class, buffer->write[class], buffer->read[class]);
 
-	// check if buffer is empty
-	if (buffer->read == buffer->write)
-		return BUFFER_FAIL;
+	// a full queue that drops new packets needs no packet built, dropping the head waits for BufferIn()
+	if (BufferLength(buffer, class) == BUFFER_SIZE - 1 && buffer_drop_policies[class] == BUFFER_DROP_TAIL) {
+		buffer->dropped[class]++;
+		return NULL;
+	}
+	entry = BufferPoolHasRoom(buffer, class) ? memb_alloc(&buffer_pool) : NULL;
+	if (entry == NULL) {
+		buffer->dropped[class]++;
+		return NULL;
+	}
+	buffer->taken[class]++;
+	entry->class = class;
+	entry->fanout = 0;
+	entry->from = 0;
+	entry->resend = false;
+	entry->unicast = false;
+	return entry;
+}
 
-	// get packet and timer from the buffer
-	*packet = buffer->packets[buffer->read];
-	*packet_timer = buffer->timers[buffer->read];
-	*forward = buffer->forward[buffer->read];
-	*reply_to_send_lsdb_req = buffer->reply_to_send_lsdb_req[buffer->read];
-	*dst = buffer->dst[buffer->read];
+uint8_t BufferIn(Buffer *buffer, BufferEntry *entry)
+{
+	uint8_t class = entry->class;
 
-	buffer->read++;
-	// if reached end of buffer set read pointer to 0
-	if (buffer->read >= BUFFER_SIZE)
-		buffer->read = 0;
+	// check if buffer is full, a resent packet was not counted by BufferAlloc()
+	if (BufferLength(buffer, class) == BUFFER_SIZE - 1) {
+		buffer->dropped[class]++;
+		if (buffer_drop_policies[class] == BUFFER_DROP_TAIL)
+			return BUFFER_FAIL;
+		// make room by dropping the oldest packet
+		BufferFree(buffer, BufferPop(buffer, class));
+	}
+	buffer->queues[class][buffer->write[class]] = entry;
 
+	buffer->write[class]++;
+	// if reached end of buffer set write pointer to 0
+	if (buffer->write[class] >= BUFFER_SIZE)
+		buffer->write[class] = 0;
 	return BUFFER_SUCCESS;
 }
 
+void BufferFree(Buffer *buffer, BufferEntry *entry)
+{
+	buffer->taken[entry->class]--;
+	memb_free(&buffer_pool, entry);
+}
+
+BufferEntry *BufferNext(Buffer *buffer, uint8_t mask)
+{
+	uint8_t c;
+	uint8_t round;
+
+	// a second pass after starting a new round, if no class with credit left was ready
+	for (round = 0; round < 2; round++) {
+		for (c = 0; c < BUFFER_CLASSES; c++) {
+			if ((mask & BUFFER_CLASS_MASK(c)) == 0 || !BufferReady(buffer, c))
+				continue;
+			if (!BUFFER_STRICT_PRIORITY && buffer->credit[c] == 0)
+				continue;
+
+			// for debug:
+			printf("BufferNext: class: %d, write: %d, read: %d\r\n", c, buffer->write[c], buffer->read[c]);
+
+			if (buffer->credit[c] > 0)
+				buffer->credit[c]--;
+			return buffer->queues[c][buffer->read[c]];
+		}
+		for (c = 0; c < BUFFER_CLASSES; c++)
+			buffer->credit[c] = buffer_weights[c];
+	}
+
+	return NULL;
+}
+
+BufferEntry *BufferHead(Buffer *buffer, uint8_t class)
+{
+	if (buffer->read[class] == buffer->write[class])
+		return NULL;
+	return buffer->queues[class][buffer->read[class]];
+}
+
+void BufferRemove(Buffer *buffer, BufferEntry *entry)
+{
+	uint8_t class = entry->class;
+
+	if (buffer->read[class] != buffer->write[class] && buffer->queues[class][buffer->read[class]] == entry)
+		BufferPop(buffer, class);
+}
+
+uint8_t BufferNextReady(Buffer *buffer, uint8_t mask, clock_time_t *remaining)
+{
+	uint8_t c;
+	uint8_t return_code = BUFFER_FAIL;
+	clock_time_t left;
+	struct timer *timer;
+
+	for (c = 0; c < BUFFER_CLASSES; c++) {
+		if ((mask & BUFFER_CLASS_MASK(c)) == 0 || buffer->read[c] == buffer->write[c])
+			continue;
+		timer = &buffer->queues[c][buffer->read[c]]->timer;
+		left = timer_expired(timer) ? 0 : timer_remaining(timer);
+		if (return_code == BUFFER_FAIL || left < *remaining)
+			*remaining = left;
+		return_code = BUFFER_SUCCESS;
+	}
+
+	return return_code;
+}
+
+uint8_t BufferLength(Buffer *buffer, uint8_t class)
+{
+	if (buffer->write[class] >= buffer->read[class])
+		return buffer->write[class] - buffer->read[class];
+	return BUFFER_SIZE - buffer->read[class] + buffer->write[class];
+}
@@ -4,15 +4,32 @@
 #define BUFFER_H
 
 #include "contiki.h"
+#include "lib/memb.h"
 
 #include <stdint.h>
 #include <helper.c>
 
-/**Maximum size of the buffer.*/
+#if TOTAL_NODES > 16
+#error "The neighbours a packet still has to be sent to are a 16 bit mask."
+#endif
+
+/**Maximum size of the queue of every traffic class.*/
 #ifndef BUFFER_SIZE
 #define BUFFER_SIZE 15
 #endif
 
+/**Number of packets in the pool, shared by the queues of all traffic classes.*/
+#ifndef BUFFER_POOL_SIZE
+#define BUFFER_POOL_SIZE 20
+#endif
+
+/**Packets of the pool reserved for every class, in the order of the classes. The other
+ * classes can't take them, so a burst of one class doesn't starve the others.
+ * @warning Their sum must not exceed BUFFER_POOL_SIZE.*/
+#ifndef BUFFER_POOL_RESERVED
+#define BUFFER_POOL_RESERVED {6, 4, 1}
+#endif
+
 /**Return code for buffer failure.*/
 #ifndef BUFFER_FAIL
 #define BUFFER_FAIL 0
@@ -23,25 +40,104 @@
 #define BUFFER_SUCCESS  1
 #endif
 
-/**@brief Buffer structure used for outgoing LSA packets.*/
+/**Traffic class of flooded LSAs and of the unicasts that ask for or announce a LSDB, keeps the routes right.*/
+#define BUFFER_CONTROL 0
+/**Traffic class of sensor data, ours and forwarded.*/
+#define BUFFER_DATA 1
+/**Traffic class of LSDB transfers to a neighbour, many packets at once.*/
+#define BUFFER_BULK 2
+/**Number of traffic classes, in order of priority.*/
+#define BUFFER_CLASSES 3
+
+/**Mask of a traffic class, for BufferNext().*/
+#define BUFFER_CLASS_MASK(class) (1 << (class))
+/**Mask of all traffic classes.*/
+#define BUFFER_ALL_CLASSES ((1 << BUFFER_CLASSES) - 1)
+
+/**Drop policy: a full queue drops the new packet.*/
+#define BUFFER_DROP_TAIL 0
+/**Drop policy: a full queue drops its oldest packet to make room.*/
+#define BUFFER_DROP_HEAD 1
+
+/**Packets a class may send per round, in the order of the classes.
+ * Once every class with a packet ready used up its share, a new round starts.*/
+#ifndef BUFFER_WEIGHTS
+#define BUFFER_WEIGHTS {4, 2, 1}
+#endif
+
+/**If true, a class only sends when no class before it has a packet ready. BUFFER_WEIGHTS is ignored.*/
+#ifndef BUFFER_STRICT_PRIORITY
+#define BUFFER_STRICT_PRIORITY false
+#endif
+
+/**Drop policy of every class. Lost LSAs are only repaired by a LSDB transfer, and a
+ * LSDB transfer is retried if it is incomplete, so both keep what they have.
+ * A newer sample is worth more than an old one.*/
+#ifndef BUFFER_DROP_POLICIES
+#define BUFFER_DROP_POLICIES {BUFFER_DROP_TAIL, BUFFER_DROP_HEAD, BUFFER_DROP_TAIL}
+#endif
+
+/**@brief Packet waiting for transmission, taken from the pool.
+ * It is built in place and sent from here, to every neighbour in fanout.*/
 typedef struct
 {
-	struct timer timers[BUFFER_SIZE];
-	struct lsa packets[BUFFER_SIZE];
-	bool forward[BUFFER_SIZE];
-	bool reply_to_send_lsdb_req[BUFFER_SIZE];
-	linkaddr_t dst[BUFFER_SIZE];
-	uint8_t read;
-	uint8_t write;
+	struct timer timer;/**<Pre-backoff, the packet is not sent before it expired.*/
+	union{
+		struct lsa lsa;/**<LSA, in the control and bulk classes.*/
+		struct unicast_packet data;/**<Data packet, in the data class.*/
+	}packet;
+	uint8_t class;/**<Traffic class.*/
+	uint16_t fanout;/**<Bit i set if the packet still has to be sent to node i+1.*/
+	uint8_t from;/**<Data packet: node we got it from, 0 if it is our own.*/
+	bool resend;/**<Data packet: already sent once over another next hop.*/
+	bool unicast;/**<Control class: a unicast packet in packet.data (LSDB age or request) instead of a LSA.*/
+}BufferEntry;
+
+/**@brief Buffer structure used for outgoing packets, one queue per traffic class.
+ * The queues hold packets of a pool, which only one buffer uses.*/
+typedef struct
+{
+	BufferEntry *queues[BUFFER_CLASSES][BUFFER_SIZE];
+	uint8_t read[BUFFER_CLASSES];
+	uint8_t write[BUFFER_CLASSES];
+	uint8_t credit[BUFFER_CLASSES];/**<Packets the class may still send this round.*/
+	uint16_t dropped[BUFFER_CLASSES];/**<Packets dropped because the queue or the pool was full.*/
+	uint8_t taken[BUFFER_CLASSES];/**<Packets the class took from the pool, queued or not.*/
 }Buffer;
 
-// puts a packet and a timer in the buffer
-// returns BUFFER_FAIL if buffer is full
-uint8_t BufferIn(Buffer *buffer, struct lsa packet, struct timer packet_timer, bool forward, bool reply_to_send_lsdb_req, linkaddr_t dst);
+// empties all queues and the pool
+void BufferInit(Buffer *buffer);
 
-// removes a packet from a buffer
-// returns BUFFER_FAIL if buffer is empty
-uint8_t BufferOut(Buffer *buffer, struct lsa *packet, struct timer *packet_timer, bool *forward, bool *reply_to_send_lsdb_req, linkaddr_t *dst);
+// takes a packet of a class from the pool, to be filled and put in with BufferIn()
+// packets reserved for other classes (BUFFER_POOL_RESERVED) are left to them
+// returns NULL if the packet has to be dropped, a full queue that drops its head still gives one
+BufferEntry *BufferAlloc(Buffer *buffer, uint8_t class);
 
-#endif /* BUFFER_H */
+// puts a packet taken with BufferAlloc() in the queue of its class
+// a full queue applies the drop policy of the class, dropping the oldest packet or this one
+// returns BUFFER_FAIL if this packet was not put in, it is left to the caller to free it
+uint8_t BufferIn(Buffer *buffer, BufferEntry *entry);
+
+// returns a packet taken with BufferAlloc() to the pool, it must not be in a queue
+void BufferFree(Buffer *buffer, BufferEntry *entry);
 
+// returns the next packet to send among the classes in mask, whose pre-backoff expired
+// it stays at the head of its queue until BufferRemove()
+// returns NULL if there is none
+BufferEntry *BufferNext(Buffer *buffer, uint8_t mask);
+
+// returns the packet at the head of the queue of a class, whether its pre-backoff expired or not
+// returns NULL if the queue is empty
+BufferEntry *BufferHead(Buffer *buffer, uint8_t class);
+
+// removes a packet returned by BufferNext() from its queue, it is still taken from the pool
+void BufferRemove(Buffer *buffer, BufferEntry *entry);
+
+// time until the next packet among the classes in mask is ready
+// returns BUFFER_FAIL if their queues are empty
+uint8_t BufferNextReady(Buffer *buffer, uint8_t mask, clock_time_t *remaining);
+
+// number of packets in the queue of a class
+uint8_t BufferLength(Buffer *buffer, uint8_t class);
+
+#endif /* BUFFER_H */
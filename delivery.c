@@ -0,0 +1,105 @@
+
+#include "delivery.h"
+#include <string.h>
+
+/**Sequence numbers remembered, the bits of Delivery.seen.*/
+#define DELIVERY_WINDOW 32
+
+static DeliveryPath *DeliveryFindPath(Delivery *delivery, const uint8_t *path, uint8_t length)
+{
+	DeliveryPath *least = &delivery->paths[0];
+	uint8_t i;
+
+	if (length > TOTAL_NODES)
+		length = TOTAL_NODES;
+	for (i = 0; i < DELIVERY_PATHS; i++) {
+		if (delivery->paths[i].length == length && memcmp(delivery->paths[i].hops, path, length) == 0)
+			return &delivery->paths[i];
+		if (delivery->paths[i].length == 0 || (least->length != 0 && delivery->paths[i].received < least->received))
+			least = &delivery->paths[i];
+	}
+	memset(least, 0, sizeof(DeliveryPath));
+	memcpy(least->hops, path, length);
+	least->length = length;
+	return least;
+}
+
+void DeliveryInit(Delivery *delivery)
+{
+	memset(delivery, 0, sizeof(Delivery));
+}
+
+uint8_t DeliveryAdd(Delivery *delivery, uint16_t epoch, uint16_t seq, const uint8_t *path, uint8_t length)
+{
+	DeliveryPath *entry = DeliveryFindPath(delivery, path, length);
+	int16_t ahead = (int16_t)(seq - delivery->newest);
+
+	if (!delivery->valid || epoch != delivery->epoch) {
+		// first packet, or the sensor restarted
+		if (delivery->valid)
+			delivery->restarts++;
+		delivery->epoch = epoch;
+		delivery->newest = seq;
+		delivery->seen = 1;
+		delivery->expected++;
+		delivery->valid = true;
+	} else if (ahead <= -DELIVERY_WINDOW) {
+		// too old to tell, counted as lost, so it was reordered unless it is a duplicate
+		delivery->reordered++;
+		if (entry->reordered < 0xFFFF)
+			entry->reordered++;
+	} else if (ahead > 0) {
+		delivery->seen = ahead < DELIVERY_WINDOW ? (delivery->seen << ahead) | 1 : 1;
+		delivery->newest = seq;
+		delivery->expected += ahead;
+	} else if (delivery->seen & ((uint32_t)1 << -ahead)) {
+		delivery->duplicates++;
+		if (entry->duplicates < 0xFFFF)
+			entry->duplicates++;
+		return DELIVERY_FAIL;
+	} else {
+		// counted as lost when a newer one arrived
+		delivery->seen |= (uint32_t)1 << -ahead;
+		delivery->reordered++;
+		if (entry->reordered < 0xFFFF)
+			entry->reordered++;
+	}
+	delivery->received++;
+	if (entry->received < 0xFFFF)
+		entry->received++;
+	return DELIVERY_SUCCESS;
+}
+
+uint8_t DeliverySeenAdd(DeliverySeen *seen, uint16_t epoch, uint16_t seq)
+{
+	int16_t ahead = (int16_t)(seq - seen->newest);
+
+	if (!seen->valid || epoch != seen->epoch) {
+		seen->epoch = epoch;
+		seen->newest = seq;
+		seen->seen = 1;
+		seen->valid = true;
+	} else if (ahead <= -DELIVERY_WINDOW) {
+		return DELIVERY_FAIL;
+	} else if (ahead > 0) {
+		seen->seen = ahead < DELIVERY_WINDOW ? (seen->seen << ahead) | 1 : 1;
+		seen->newest = seq;
+	} else if (seen->seen & ((uint32_t)1 << -ahead)) {
+		return DELIVERY_FAIL;
+	} else {
+		seen->seen |= (uint32_t)1 << -ahead;
+	}
+	return DELIVERY_SUCCESS;
+}
+
+uint32_t DeliveryLost(const Delivery *delivery)
+{
+	return delivery->expected > delivery->received ? delivery->expected - delivery->received : 0;
+}
+
+uint16_t DeliveryRatio(const Delivery *delivery)
+{
+	if (delivery->expected == 0)
+		return 0;
+	return (delivery->expected - DeliveryLost(delivery)) * 1000 / delivery->expected;
+}
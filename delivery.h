@@ -0,0 +1,77 @@
+/**@file delivery.h*/
+
+#ifndef DELIVERY_H
+#define DELIVERY_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**Return code for a packet received before.*/
+#define DELIVERY_FAIL 0
+
+/**Return code for a new packet.*/
+#define DELIVERY_SUCCESS 1
+
+/**@brief Packets of a sensor that took the same path.
+ * Which path a lost packet took is unknown, so there are no losses per path.*/
+typedef struct
+{
+	uint8_t hops[TOTAL_NODES];/**<Nodes on the path, from the sensor on.*/
+	uint8_t length;/**<Number of hops, 0 if the entry is free.*/
+	uint16_t received;/**<New packets that took it.*/
+	uint16_t duplicates;/**<Packets received before that took it.*/
+	uint16_t reordered;/**<Packets that took it and arrived after a newer one.*/
+}DeliveryPath;
+
+/**@brief Data packets of one node received lately, to drop the copies of its resent packets.
+ * Kept for the nodes whose packets count for no delivery, like the flood reports of bridges.*/
+typedef struct
+{
+	uint16_t epoch;/**<Boot epoch of the node the sequence numbers belong to.*/
+	uint16_t newest;/**<Highest sequence number received.*/
+	uint32_t seen;/**<Bit i set if newest - i was received.*/
+	bool valid;/**<True once a packet was received.*/
+}DeliverySeen;
+
+/**@brief Delivery of the data packets of one sensor, kept by the sink.
+ * Every sensor numbers its data packets. A sequence number skipped is a loss until the
+ * packet still turns up, then it was reordered. The last 32 sequence numbers are
+ * remembered to tell duplicates from reordered packets. The sensor picks a new epoch when
+ * it boots, a packet of another epoch means it restarted and counting goes on from there.
+ * A packet is only a duplicate if its epoch matches.*/
+typedef struct
+{
+	uint16_t epoch;/**<Boot epoch of the sensor the sequence numbers belong to.*/
+	uint16_t newest;/**<Highest sequence number received.*/
+	uint32_t seen;/**<Bit i set if newest - i was received.*/
+	uint32_t expected;/**<Packets the sensor sent, as far as we know.*/
+	uint32_t received;/**<New packets.*/
+	uint32_t duplicates;/**<Packets received before.*/
+	uint32_t reordered;/**<Packets that arrived after a newer one.*/
+	uint16_t restarts;/**<Times the sensor restarted, with a new epoch.*/
+	bool valid;/**<True once a packet was received.*/
+	DeliveryPath paths[DELIVERY_PATHS];/**<Paths taken most, a path replaces the one taken least.*/
+}Delivery;
+
+// forgets all packets
+void DeliveryInit(Delivery *delivery);
+
+// adds a packet with sequence number seq of boot epoch epoch, that took the hops of path
+// returns DELIVERY_FAIL if it was received before
+uint8_t DeliveryAdd(Delivery *delivery, uint16_t epoch, uint16_t seq, const uint8_t *path, uint8_t length);
+
+// remembers a packet with sequence number seq of boot epoch epoch
+// returns DELIVERY_FAIL if it was received before, or is too old to tell
+uint8_t DeliverySeenAdd(DeliverySeen *seen, uint16_t epoch, uint16_t seq);
+
+// returns the packets lost so far
+uint32_t DeliveryLost(const Delivery *delivery);
+
+// returns the share of packets received, in permille
+uint16_t DeliveryRatio(const Delivery *delivery);
+
+#endif /* DELIVERY_H */
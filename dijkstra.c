@@ -1,25 +1,17 @@
 // Dijkstra's Algorithm in C
+// Used by routing.c to compute the routing table, and as a small test
+// program on the host (gcc -I. dijkstra.c -o dijkstra).
 
 #include <stdio.h>
-#define INFINITY 9999
-#define MAX 13
+#include "dijkstra.h"
 
-void Dijkstra(int Graph[MAX][MAX], int n, int start);
+void Dijkstra(uint16_t graph[TOTAL_NODES][TOTAL_NODES], uint8_t start, uint16_t distance[TOTAL_NODES], uint8_t pred[TOTAL_NODES]) {
+  uint8_t visited[TOTAL_NODES];
+  uint16_t mindistance;
+  uint8_t nextnode, i, count;
 
-void Dijkstra(int Graph[MAX][MAX], int n, int start) {
-  int cost[MAX][MAX], distance[MAX], pred[MAX];
-  int visited[MAX], count, mindistance, nextnode, i, j;
-
-  // Creating cost matrix
-  for (i = 0; i < n; i++)
-    for (j = 0; j < n; j++)
-      if (Graph[i][j] == 0)
-        cost[i][j] = INFINITY;
-      else
-        cost[i][j] = Graph[i][j];
-
-  for (i = 0; i < n; i++) {
-    distance[i] = cost[start][i];
+  for (i = 0; i < TOTAL_NODES; i++) {
+    distance[i] = graph[start][i] == 0 ? DIJKSTRA_INFINITY : graph[start][i];
     pred[i] = start;
     visited[i] = 0;
   }
@@ -28,53 +20,120 @@ void Dijkstra(int Graph[MAX][MAX], int n, int start) {
   visited[start] = 1;
   count = 1;
 
-  while (count < n - 1) {
-    mindistance = INFINITY;
+  while (count < TOTAL_NODES) {
+    mindistance = DIJKSTRA_INFINITY;
+    nextnode = start;
 
-    for (i = 0; i < n; i++)
+    for (i = 0; i < TOTAL_NODES; i++)
       if (distance[i] < mindistance && !visited[i]) {
         mindistance = distance[i];
         nextnode = i;
       }
+    if (nextnode == start)
+      break; // the rest is unreachable
 
     visited[nextnode] = 1;
-    for (i = 0; i < n; i++)
-      if (!visited[i])
-        if (mindistance + cost[nextnode][i] < distance[i]) {
-          distance[i] = mindistance + cost[nextnode][i];
+    for (i = 0; i < TOTAL_NODES; i++)
+      if (!visited[i] && graph[nextnode][i] != 0)
+        if ((uint32_t)mindistance + graph[nextnode][i] < distance[i]) {
+          distance[i] = mindistance + graph[nextnode][i];
           pred[i] = nextnode;
         }
     count++;
   }
+}
+
+void RoutingTableCompute(RoutingTable *table, uint16_t graph[TOTAL_NODES][TOTAL_NODES], uint8_t me) {
+  // distances from me and from each of my neighbours
+  static uint16_t distance[TOTAL_NODES][TOTAL_NODES];
+  static uint8_t pred[TOTAL_NODES];
+  uint8_t s = me - 1;
+  uint8_t d, n, p, j;
+  uint32_t via;
+  uint32_t best;
+  bool protecting;
+
+  for (n = 0; n < TOTAL_NODES; n++)
+    if (n == s || graph[s][n] != 0)
+      Dijkstra(graph, n, distance[n], pred);
+  // last run from me, so pred is my shortest path tree
+  Dijkstra(graph, s, distance[s], pred);
+
+  for (d = 0; d < TOTAL_NODES; d++) {
+    Route *route = &table->routes[d];
+    route->next_hop = 0;
+    route->backup = 0;
+    route->node_protecting = false;
+    route->candidates = 0;
+    route->cost = distance[s][d];
+    if (d == s || distance[s][d] == DIJKSTRA_INFINITY)
+      continue;
+
+    // walk back to the first hop
+    j = d;
+    while (pred[j] != s)
+      j = pred[j];
+    p = j;
+    route->next_hop = p + 1;
+
+    // near equal cost next hops for load balancing, only downstream ones so there are no loops
+    for (n = 0; n < TOTAL_NODES; n++) {
+      if (n == s || graph[s][n] == 0 || distance[n][d] >= distance[s][d])
+        continue;
+      via = (uint32_t)graph[s][n] + distance[n][d];
+      if (via * 100 <= (uint32_t)distance[s][d] * (100 + MULTIPATH_STRETCH))
+        route->candidates |= 1 << n;
+    }
 
-  // Printing the distance
-  for (i = 0; i < n; i++)
-    if (i != start) {
-      printf("\nDistance from source %d to %d: %d\n", start, i, distance[i]);
-			printf("Path= %d",i);
-			j=i;
-			do{
-				j=pred[j];
-				printf(" <- %d",j);
-			}while(j!=start);
+    // loop free alternates: neighbours whose shortest path to d doesn't come back over me.
+    // Node protecting ones, that don't go over the primary next hop either, are preferred.
+    best = DIJKSTRA_INFINITY;
+    for (n = 0; n < TOTAL_NODES; n++) {
+      if (n == s || n == p || graph[s][n] == 0 || distance[n][d] == DIJKSTRA_INFINITY)
+        continue;
+      if ((uint32_t)distance[n][d] >= (uint32_t)distance[n][s] + distance[s][d])
+        continue;
+      protecting = d != p && (uint32_t)distance[n][d] < (uint32_t)distance[n][p] + distance[p][d];
+      via = (uint32_t)graph[s][n] + distance[n][d];
+      if (route->backup == 0 || (protecting && !route->node_protecting) ||
+          (protecting == route->node_protecting && via < best)) {
+        route->backup = n + 1;
+        route->node_protecting = protecting;
+        best = via;
+      }
     }
+  }
 }
+
+#ifndef CONTIKI
 int main() {
-  int Graph[MAX][MAX], i, j, n, u;
-  n = MAX;
-
-  for(i=0;i<MAX;i++){
-		for(j=0;j<MAX;j++){
-			Graph[i][j] = 0;
-		}
-	}
-	Graph[11][3] = 1;
-  Graph[11][5] = 1;
-	Graph[3][1] = 1;
-	Graph[5][1] = 1;
-
-  u = 11;
-  Dijkstra(Graph, n, u);
+  static uint16_t Graph[TOTAL_NODES][TOTAL_NODES];
+  RoutingTable table;
+  uint8_t i, u;
+
+  // bridges 3, 5 and 7 around the sink, 7 only reaches it over 3 or 5
+  Graph[2][0] = Graph[0][2] = 16;
+  Graph[4][0] = Graph[0][4] = 20;
+  Graph[2][4] = Graph[4][2] = 16;
+  Graph[6][2] = Graph[2][6] = 16;
+  Graph[6][4] = Graph[4][6] = 18;
+  Graph[11][6] = 16;
+
+  u = 12;
+  RoutingTableCompute(&table, Graph, u);
+
+  for (i = 0; i < TOTAL_NODES; i++)
+    if (i + 1 != u && table.routes[i].next_hop != 0)
+      printf("To %d: cost %d, next hop %d, backup %d%s, candidates 0x%04x\n", i + 1, table.routes[i].cost,
+             table.routes[i].next_hop, table.routes[i].backup,
+             table.routes[i].node_protecting ? " (node protecting)" : "", table.routes[i].candidates);
+
+  u = 7;
+  RoutingTableCompute(&table, Graph, u);
+  printf("From %d to %d: cost %d, next hop %d, backup %d%s, candidates 0x%04x\n", u, SINK_ID, table.routes[SINK_ID - 1].cost,
+         table.routes[SINK_ID - 1].next_hop, table.routes[SINK_ID - 1].backup,
+         table.routes[SINK_ID - 1].node_protecting ? " (node protecting)" : "", table.routes[SINK_ID - 1].candidates);
 
   return 0;
 }
+#endif
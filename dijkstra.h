@@ -0,0 +1,40 @@
+/**@file dijkstra.h*/
+
+#ifndef DIJKSTRA_H
+#define DIJKSTRA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**Distance of a node we can't reach.*/
+#define DIJKSTRA_INFINITY 0xFFFF
+
+#if TOTAL_NODES > 16
+#error "The next hop candidates of a route are a 16 bit mask."
+#endif
+
+/**@brief Route to a destination.*/
+typedef struct
+{
+	uint8_t next_hop;/**<Neighbour on the shortest path. 0 if the destination is unreachable.*/
+	uint8_t backup;/**<Loop free alternate next hop, used right away when next_hop fails. 0 if none.*/
+	bool node_protecting;/**<True if the path over backup doesn't go through next_hop either.*/
+	uint16_t candidates;/**<Bit i set if node i+1 is a next hop with a path at most MULTIPATH_STRETCH percent more expensive, and closer to the destination than us.*/
+	uint16_t cost;/**<Cost of the shortest path.*/
+}Route;
+
+/**@brief Routes of a node to every other node.*/
+typedef struct
+{
+	Route routes[TOTAL_NODES];/**<Route to node X.*/
+}RoutingTable;
+
+// shortest path costs from start (index) to every node, pred[i] is the node before i on the path
+void Dijkstra(uint16_t graph[TOTAL_NODES][TOTAL_NODES], uint8_t start, uint16_t distance[TOTAL_NODES], uint8_t pred[TOTAL_NODES]);
+
+// computes the routes of node me (node id) from the LSDB link costs
+void RoutingTableCompute(RoutingTable *table, uint16_t graph[TOTAL_NODES][TOTAL_NODES], uint8_t me);
+
+#endif /* DIJKSTRA_H */
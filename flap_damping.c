@@ -0,0 +1,117 @@
+
+#include "flap_damping.h"
+#include <stdio.h>
+#include <string.h>
+
+// penalty of the link to neighbour i+1 now
+// it halves every whole half life and decays linearly to the next half in between, so it
+// is exact every half life and never grows. Nothing is stored, rounding doesn't add up.
+static uint16_t FlapDampingPenalty(FlapDamping *damping, uint8_t i)
+{
+	clock_time_t elapsed = clock_time() - damping->updated[i];
+	uint16_t penalty = damping->penalty[i];
+	uint16_t decrement;
+
+	while (elapsed >= FLAP_HALF_LIFE && penalty > 0) {
+		penalty >>= 1;
+		elapsed -= FLAP_HALF_LIFE;
+	}
+	if (penalty == 0)
+		return 0;
+	decrement = (uint32_t)penalty * elapsed / FLAP_HALF_LIFE / 2;
+	if (decrement > penalty)
+		decrement = penalty;
+	return penalty - decrement;
+}
+
+void FlapDampingInit(FlapDamping *damping)
+{
+	memset(damping, 0, sizeof(FlapDamping));
+}
+
+void FlapDampingFlap(FlapDamping *damping, uint8_t id)
+{
+	uint8_t i = id - 1;
+
+	damping->penalty[i] = FlapDampingPenalty(damping, i);
+	damping->updated[i] = clock_time();
+	if (damping->penalty[i] > FLAP_MAX_PENALTY - FLAP_PENALTY)
+		damping->penalty[i] = FLAP_MAX_PENALTY;
+	else
+		damping->penalty[i] += FLAP_PENALTY;
+	if (damping->penalty[i] >= FLAP_SUPPRESS && !damping->suppressed[i]) {
+		damping->suppressed[i] = true;
+		printf("Link to %d is flapping (penalty %d), suppressed\n", id, damping->penalty[i]);
+	}
+}
+
+bool FlapDampingSuppressed(FlapDamping *damping, uint8_t id)
+{
+	uint8_t i = id - 1;
+	uint16_t penalty;
+
+	if (!damping->suppressed[i])
+		return false;
+	penalty = FlapDampingPenalty(damping, i);
+	if (penalty < FLAP_REUSE) {
+		damping->suppressed[i] = false;
+		printf("Link to %d can be used again (penalty %d)\n", id, penalty);
+	}
+	return damping->suppressed[i];
+}
+
+#ifndef CONTIKI
+// Host check (gcc -I. flap_damping.c -o flap_damping): two flaps 10 s apart, then none.
+// The penalty must never grow and must halve over every half life.
+static clock_time_t now;
+
+clock_time_t clock_time(void)
+{
+	return now;
+}
+
+int main()
+{
+	FlapDamping damping;
+	uint16_t start, last, penalty;
+	clock_time_t t;
+	int failed = 0;
+
+	FlapDampingInit(&damping);
+	FlapDampingFlap(&damping, 2);
+	now += 10 * CLOCK_SECOND;
+	FlapDampingFlap(&damping, 2);
+	start = last = FlapDampingPenalty(&damping, 1);
+	printf("After the second flap: %d\n", start);
+
+	for (t = 1; t <= 3 * FLAP_HALF_LIFE; t++) {
+		now++;
+		penalty = FlapDampingPenalty(&damping, 1);
+		if (penalty > last) {
+			printf("FAIL: penalty grew from %d to %d after %lu s\n", last, penalty, (unsigned long)(t / CLOCK_SECOND));
+			failed = 1;
+			break;
+		}
+		last = penalty;
+		if (t % FLAP_HALF_LIFE == 0) {
+			printf("After %lu half lives: %d\n", (unsigned long)(t / FLAP_HALF_LIFE), penalty);
+			if (penalty != start >> (t / FLAP_HALF_LIFE)) {
+				printf("FAIL: expected %d\n", start >> (t / FLAP_HALF_LIFE));
+				failed = 1;
+			}
+		}
+	}
+
+	// a third flap suppresses the link until the penalty is below FLAP_REUSE
+	FlapDampingFlap(&damping, 2);
+	FlapDampingFlap(&damping, 2);
+	for (t = 0; FlapDampingSuppressed(&damping, 2) && t < 10 * FLAP_HALF_LIFE; t += CLOCK_SECOND)
+		now += CLOCK_SECOND;
+	printf("Suppressed for %lu s\n", (unsigned long)(t / CLOCK_SECOND));
+	if (t >= 10 * FLAP_HALF_LIFE)
+		failed = 1;
+
+	printf(failed ? "FAIL\n" : "PASS\n");
+	return failed;
+}
+#endif
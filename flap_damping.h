@@ -0,0 +1,41 @@
+/**@file flap_damping.h*/
+
+#ifndef FLAP_DAMPING_H
+#define FLAP_DAMPING_H
+
+#ifdef CONTIKI
+#include "contiki.h"
+#else
+// host build of the check in flap_damping.c, which sets the clock
+typedef unsigned long clock_time_t;
+#define CLOCK_SECOND 128
+clock_time_t clock_time(void);
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Flap damping of our own links.
+ * Every time the link to a neighbour goes down it gets FLAP_PENALTY, which halves
+ * every FLAP_HALF_LIFE, linearly in between. Once the penalty reaches FLAP_SUPPRESS the link is not
+ * advertised again until the penalty decayed below FLAP_REUSE.
+ * Links going down are always advertised, a link that doesn't work must not attract traffic.*/
+typedef struct
+{
+	uint16_t penalty[TOTAL_NODES];/**<Penalty of the link to neighbour X at updated, it decays from there.*/
+	clock_time_t updated[TOTAL_NODES];/**<When the link to neighbour X last flapped.*/
+	bool suppressed[TOTAL_NODES];/**<True if the link to neighbour X must not be advertised.*/
+}FlapDamping;
+
+// no penalties
+void FlapDampingInit(FlapDamping *damping);
+
+// the link to neighbour id went down
+void FlapDampingFlap(FlapDamping *damping, uint8_t id);
+
+// returns true if the link to neighbour id must not be advertised (yet)
+bool FlapDampingSuppressed(FlapDamping *damping, uint8_t id);
+
+#endif /* FLAP_DAMPING_H */
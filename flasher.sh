@@ -5,7 +5,6 @@
 RED='\033[0;31m'
 NC='\033[0m' # No Color
 
-BINARY=routing.upload
 
 ports=($(ls -d /dev/ttyUSB* 2>/dev/null))
 
@@ -26,8 +25,20 @@ do
 	if [ "${flash,,}" == "y" ]
 	then
 		read -p "Node id? " node_id
-		echo -e "${RED}Flashing port $i with node id $node_id${NC}"
-		make TARGET=zoul BOARD=remote-revb NODEID=0x$node_id PORT=$i $BINARY
+		# Role image that fits the node id: node 1 is the sink, odd ids bridges, even ids sensor motes
+		if [ $((16#$node_id)) -eq 1 ]
+		then
+			role=sink
+		elif [ $((16#$node_id % 2)) -eq 0 ]
+		then
+			role=sensor
+		else
+			role=bridge
+		fi
+		read -p "Image? (sink/bridge/sensor/routing) [$role] " image
+		image=${image:-$role}
+		echo -e "${RED}Flashing port $i with node id $node_id, image $image${NC}"
+		make TARGET=zoul BOARD=remote-revb NODEID=0x$node_id PORT=$i $image.upload
 	else
 		continue
 	fi
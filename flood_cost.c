@@ -0,0 +1,56 @@
+
+#include "flood_cost.h"
+#include <string.h>
+
+static uint16_t FloodCostSum(uint16_t a, uint16_t b)
+{
+	return (uint32_t)a + b < 0xFFFF ? a + b : 0xFFFF;
+}
+
+void FloodCostInit(FloodCost *cost)
+{
+	memset(cost, 0, sizeof(FloodCost));
+}
+
+FloodCount *FloodCostFind(FloodCost *cost, uint8_t origin, uint8_t id)
+{
+	FloodCount *oldest = &cost->events[0];
+	uint8_t i;
+
+	for (i = 0; i < FLOOD_EVENTS; i++) {
+		if (cost->events[i].origin == origin && cost->events[i].id == id) {
+			cost->events[i].updated = clock_time();
+			return &cost->events[i];
+		}
+		if (oldest->origin != 0 && (cost->events[i].origin == 0 ||
+				(clock_time_t)(clock_time() - cost->events[i].updated) > (clock_time_t)(clock_time() - oldest->updated)))
+			oldest = &cost->events[i];
+	}
+	memset(oldest, 0, sizeof(FloodCount));
+	oldest->origin = origin;
+	oldest->id = id;
+	oldest->updated = clock_time();
+	return oldest;
+}
+
+FloodCount *FloodCostQuiet(FloodCost *cost, clock_time_t quiet)
+{
+	uint8_t i;
+
+	for (i = 0; i < FLOOD_EVENTS; i++) {
+		if (cost->events[i].origin != 0 && !cost->events[i].reported &&
+				(clock_time_t)(clock_time() - cost->events[i].updated) >= quiet)
+			return &cost->events[i];
+	}
+	return NULL;
+}
+
+void FloodCostAdd(FloodCount *total, uint16_t tx, uint16_t retx, uint16_t duplicates, uint16_t received)
+{
+	total->tx = FloodCostSum(total->tx, tx);
+	total->retx = FloodCostSum(total->retx, retx);
+	total->duplicates = FloodCostSum(total->duplicates, duplicates);
+	total->received = FloodCostSum(total->received, received);
+	if (total->nodes < 0xFF)
+		total->nodes++;
+}
@@ -0,0 +1,48 @@
+/**@file flood_cost.h*/
+
+#ifndef FLOOD_COST_H
+#define FLOOD_COST_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Cost of flooding the LSAs of one topology event.
+ * An event is named by the node it happened at and a number that node counts up.*/
+typedef struct
+{
+	uint8_t origin;/**<Node the event happened at, 0 if the entry is free.*/
+	uint8_t id;/**<Number of the event at origin.*/
+	uint8_t nodes;/**<Nodes the counts are of.*/
+	uint16_t tx;/**<LSAs sent, one per neighbour.*/
+	uint16_t retx;/**<Retransmissions of runicast.*/
+	uint16_t duplicates;/**<LSAs received that we already had.*/
+	uint16_t received;/**<LSAs received.*/
+	clock_time_t updated;/**<Last time a count changed.*/
+	bool reported;/**<True once the counts were reported.*/
+}FloodCount;
+
+/**@brief Flood costs of the last FLOOD_EVENTS topology events.
+ * A new event takes the place of the one updated longest ago.*/
+typedef struct
+{
+	FloodCount events[FLOOD_EVENTS];
+}FloodCost;
+
+// forgets all events
+void FloodCostInit(FloodCost *cost);
+
+// returns the counts of an event, new ones start at 0
+FloodCount *FloodCostFind(FloodCost *cost, uint8_t origin, uint8_t id);
+
+// returns an event not reported yet whose counts didn't change for quiet clock ticks
+// returns NULL if there is none
+FloodCount *FloodCostQuiet(FloodCost *cost, clock_time_t quiet);
+
+// adds the counts of one node to the totals of an event
+void FloodCostAdd(FloodCount *total, uint16_t tx, uint16_t retx, uint16_t duplicates, uint16_t received);
+
+#endif /* FLOOD_COST_H */
@@ -7,6 +7,15 @@
  * Nodes he hears from are added to the LSDB.
  */
 
+/**@brief Header extension of LSA and unicast packets.
+ * Getting one tells a neighbour what a keep alive would, except for the time sync and links,
+ * so nodes that keep sending don't need to broadcast keep alives as well.*/
+static struct frame_ext{
+	uint16_t battery_value;/**<My battery value, as in keep alives.*/
+	uint16_t liveness;/**<Seconds until my next keep alive or packet with this header at the latest.*/
+	uint8_t queue_load;/**<Occupancy of my data queue in percent, as in keep alives.*/
+};
+
 /**@brief Link State Advertisment (LSA) packet TODO*/
 static struct lsa{
 	//uint8_t node_id;/**<Node id of sender.*/
@@ -16,6 +25,9 @@ static struct lsa{
 	uint16_t link_cost;/**<Link cost*/
 	uint8_t endpoint_addresses[2];/**<Endpoint addresses of a link (0 => Source, 1 => Destination)*/
 	uint8_t seq_nr;/**<Sequence number.*/
+	uint8_t event_origin;/**<Node whose topology event the LSA is flooded for, 0 for LSDB transfers.*/
+	uint8_t event_id;/**<Number of the event at event_origin.*/
+	struct frame_ext ext;/**<Piggybacked keep alive information.*/
 };
 
 /**
@@ -27,16 +39,24 @@ static struct lsa{
 static struct keep_alive_packet{
 	bool get_lsdb_req;/**<If set to true it means we make a request to get someone LSDB.*/
 	uint8_t neighbours[TOTAL_NODES];/**<List of nodes we got a keep alive packet.*/
-	uint16_t battery_value;/**<My battery value, used as link cost.*/
+	uint16_t battery_value;/**<My battery value, breaks ties between parents of sensor motes.*/
+	uint32_t network_time;/**<My network time (clock ticks) when the packet was built.*/
+	uint8_t sync_depth;/**<Hops between me and the sink my network time comes from. TIMESYNC_UNSYNCED if none.*/
+	uint16_t lsdb_digest;/**<Digest of my LSDB, neighbours with a different one ask for a repair.*/
+	uint16_t liveness;/**<Seconds until my next keep alive at the latest, allowing for TRICKLE_MISSED_HELLOS lost ones.*/
+	uint16_t path_cost;/**<Cost of my path to the sink. DIJKSTRA_INFINITY if i have none or don't forward data.*/
+	uint8_t queue_load;/**<Occupancy of my data queue in percent, neighbours avoid me above BACKPRESSURE_HIGH.*/
+	uint8_t slots[TOTAL_NODES];/**<Transmit slot of node X, mine and the ones my neighbours advertised. SCHEDULE_UNKNOWN if i don't know it.*/
 };
 
 /**@brief Link state database. Keeps track of links that the current has to know
  * and the respective weights, as well as other information needed for operation.*/
 static struct link_state_database{
-	uint16_t node_links_cost[TOTAL_NODES][TOTAL_NODES];/**<NODE/SRC DEST COST*/
+	uint16_t node_links_cost[LSDB_ROWS][TOTAL_NODES];/**<NODE/SRC DEST COST, only our own row in a stub image.*/
 	uint8_t sequence_numbers[TOTAL_NODES];/**<List of sequence numbers per node.*/
 	uint16_t age;/**< With every update of the LSDB, age increases.*/
-	uint8_t ka_received[TOTAL_NODES];/**<Number of Keep Alive Packets received from neighbour X in DOWN_PERIOD.*/
+	uint16_t digest;/**<Digest of the links not starting at a sensor mote. Kept up to date by lsdb_set_cost().*/
+	uint8_t ka_received[TOTAL_NODES];/**<Number of packets received from neighbour X since it came up. Stops at 255.*/
 	uint8_t neighbours[TOTAL_NODES];/**<List of neighbours i know to be alive.*/
 };
 
@@ -45,11 +65,39 @@ static struct link_state_database{
 static struct unicast_packet{
 	bool data_packet;/**<If true this packet contains sensor data.*/
 	uint8_t data_type;/**<Depends on the value we have temperatue,moisture...*/
+	uint16_t seq;/**<Sequence number of the data packets of the sensor, lets the sink count losses.*/
+	uint16_t epoch;/**<Picked at random by the sensor when it boots, seq starts over with a new one.*/
+	bool flood_report;/**<If true batch holds a struct flood_report instead of samples.*/
 	uint16_t data;/**<Actual data from a sensor.*/
+	uint16_t timestamp;/**<Network time (seconds, wraps around) at which the data was sampled.*/
+	bool timestamp_valid;/**<False if the sensor had no network time when sampling.*/
 	uint8_t ttl;/**<Time To Live, to avoid infinite forwarding loops.*/
+	uint16_t path_cost;/**<Path cost to the sink of the node that sent the packet, checked in collection tree mode.*/
 	uint16_t lsdb_age;/**<Age of my LSDB.*/
 	bool send_lsdb;/**<If true send LSDB to sender.*/
 	uint8_t path[TOTAL_NODES];/**<The path a packet took traversing our super network.*/
+	struct frame_ext ext;/**<Piggybacked keep alive information of the node that sent the packet.*/
+#if LATENCY_TRACE
+	uint32_t created;/**<Network time (clock ticks) the packet was built at, 0 if the sensor had no network time.*/
+	uint16_t dwell[TOTAL_NODES];/**<Clock ticks the packet waited in the node at the same position in path.*/
+#endif
+	uint8_t batch_count;/**<Number of samples, the first one is data and timestamp.*/
+	uint8_t batch_length;/**<Bytes used in batch.*/
+	uint8_t batch[SAMPLE_BATCH_BYTES];/**<Samples after the first one, see sample_batch.h. Only batch_length bytes are sent.*/
+};
+
+#if SAMPLE_BATCH_BYTES < 10
+#error "A flood report is sent in the batch of a data packet, it takes 10 bytes."
+#endif
+
+/**@brief What flooding the LSAs of a topology event cost a node, sent to the sink in a data packet.*/
+static struct flood_report{
+	uint8_t origin;/**<Node the event happened at.*/
+	uint8_t id;/**<Number of the event at origin.*/
+	uint16_t tx;/**<LSAs sent, one per neighbour.*/
+	uint16_t retx;/**<Retransmissions of runicast.*/
+	uint16_t duplicates;/**<LSAs received that we already had.*/
+	uint16_t received;/**<LSAs received.*/
 };
 
 /**
@@ -83,16 +131,17 @@ static void fill_tx_lsa_pkt(struct lsa *tx_lsa_pkt, uint16_t link_cost, uint8_t
 }
 
 /**@brief Print my local LSDB.
- * @param lsdb Pointer to the local LSDB.*/
-static void print_link_state_database(struct link_state_database *lsdb){
+ * @param lsdb Pointer to the local LSDB.
+ * @param me My node id, the source of the only row of a stub image.*/
+static void print_link_state_database(struct link_state_database *lsdb, uint8_t me){
 	uint8_t i; // Nodes
 	uint8_t j; // Links
 	printf("LSDB size: %d(bytes)\n", sizeof(lsdb->node_links_cost));
-	for(i=0;i<TOTAL_NODES;i++){
+	for(i=0;i<LSDB_ROWS;i++){
 		//printf("NODE: %d\n", i+1);
 		for(j=0;j<TOTAL_NODES;j++){
 			if(lsdb->node_links_cost[i][j] != 0){
-				printf("%d->%d(%d) | ", i+1, j+1, lsdb->node_links_cost[i][j]);
+				printf("%d->%d(%d) | ", LSDB_ROWS == 1 ? me : i+1, j+1, lsdb->node_links_cost[i][j]);
 				printf("\n");
 			}
 		}
@@ -0,0 +1,41 @@
+
+#include "latency.h"
+#include <string.h>
+
+void LatencyInit(LatencyHistogram *histogram)
+{
+	memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+void LatencyAdd(LatencyHistogram *histogram, uint32_t ms)
+{
+	uint8_t bucket = 0;
+	uint32_t bound = LATENCY_RESOLUTION;
+
+	while (ms >= bound && bucket < LATENCY_BUCKETS - 1) {
+		bound <<= 1;
+		bucket++;
+	}
+	if (histogram->total == 0xFFFF)
+		return; // keep the shape instead of overflowing a bucket
+	histogram->counts[bucket]++;
+	histogram->total++;
+}
+
+uint32_t LatencyPercentile(const LatencyHistogram *histogram, uint8_t percent)
+{
+	uint32_t rank = ((uint32_t)histogram->total * percent + 99) / 100;
+	uint32_t seen = 0;
+	uint8_t bucket;
+
+	if (histogram->total == 0)
+		return 0;
+	if (rank == 0)
+		rank = 1;
+	for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+		seen += histogram->counts[bucket];
+		if (seen >= rank)
+			break;
+	}
+	return (uint32_t)LATENCY_RESOLUTION << bucket;
+}
@@ -0,0 +1,44 @@
+/**@file latency.h*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Distribution of latencies (ms), in buckets that double in range.
+ * Percentiles are the upper bound of their bucket, so they are at most twice too high.
+ * In the last bucket, which has no upper bound, they are its lower bound.*/
+typedef struct
+{
+	uint16_t counts[LATENCY_BUCKETS];
+	uint16_t total;/**<Latencies added, stops at 0xFFFF.*/
+}LatencyHistogram;
+
+/**@brief Latencies of the data packets of one sensor, kept by the sink.
+ * The time a packet waited in the queues of the nodes on its path is carried in the packet.
+ * The rest of the end-to-end latency was spent on the air: MAC retries, channel checks and
+ * the radio. More hops than usual show a routing detour.*/
+typedef struct
+{
+	LatencyHistogram end_to_end;/**<From building the packet to arriving at the sink.*/
+	LatencyHistogram queued;/**<Time waited in the nodes on the path.*/
+	LatencyHistogram air;/**<End-to-end latency without the time waited in the nodes.*/
+	LatencyHistogram hops[LATENCY_HOPS];/**<Time waited in the node X hops from the sensor, the sensor first.*/
+}LatencyStats;
+
+// empties the histogram
+void LatencyInit(LatencyHistogram *histogram);
+
+// adds a latency (ms)
+void LatencyAdd(LatencyHistogram *histogram, uint32_t ms);
+
+// returns the latency (ms) percent of the latencies are at or below, rounded up to the bucket
+// returns 0 if the histogram is empty
+uint32_t LatencyPercentile(const LatencyHistogram *histogram, uint8_t percent);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,117 @@
+
+#include "link_estimator.h"
+#include <stdio.h>
+#include <string.h>
+
+// ETX guessed from the RSSI: 1 transmission above LINK_RSSI_GOOD, up to 3 at IGNORE_RSSI_BELOW
+static uint16_t LinkEstimatorRssiEtx(int16_t rssi)
+{
+	int32_t etx;
+
+	if (rssi >= LINK_RSSI_GOOD)
+		return LINK_ETX_UNIT;
+	if (rssi <= IGNORE_RSSI_BELOW)
+		return 3 * LINK_ETX_UNIT;
+	etx = LINK_ETX_UNIT + (int32_t)(LINK_RSSI_GOOD - rssi) * 2 * LINK_ETX_UNIT / (LINK_RSSI_GOOD - IGNORE_RSSI_BELOW);
+	return (uint16_t)etx;
+}
+
+void LinkEstimatorInit(LinkEstimator *estimator)
+{
+	memset(estimator->links, 0, sizeof(estimator->links));
+}
+
+void LinkEstimatorReset(LinkEstimator *estimator, uint8_t id)
+{
+	memset(&estimator->links[id - 1], 0, sizeof(LinkEstimate));
+}
+
+void LinkEstimatorRssi(LinkEstimator *estimator, uint8_t id, int16_t rssi)
+{
+	LinkEstimate *link = &estimator->links[id - 1];
+
+	if (!link->rssi_valid) {
+		link->rssi = rssi * LINK_RSSI_EWMA;
+		link->rssi_valid = true;
+		return;
+	}
+	link->rssi += rssi - link->rssi / LINK_RSSI_EWMA;
+}
+
+// closed loop on the power margin, one step per window of transmissions
+static void LinkEstimatorAdjustPower(LinkEstimate *link, uint16_t sample)
+{
+	if (sample > LINK_POWER_TARGET_ETX) {
+		if (link->power_margin + LINK_POWER_STEP > LINK_POWER_MAX_MARGIN)
+			link->power_margin = LINK_POWER_MAX_MARGIN;
+		else
+			link->power_margin += LINK_POWER_STEP;
+	} else if (sample == LINK_ETX_UNIT && link->power_margin > 0) {
+		link->power_margin--;
+	}
+}
+
+void LinkEstimatorTx(LinkEstimator *estimator, uint8_t id, uint8_t transmissions, bool acked)
+{
+	LinkEstimate *link = &estimator->links[id - 1];
+	uint16_t sample;
+
+	link->tx += transmissions;
+	if (acked)
+		link->acked++;
+	if (link->tx < LINK_ETX_WINDOW)
+		return;
+
+	// window complete, one ETX sample
+	if (link->acked == 0 || (uint32_t)link->tx * LINK_ETX_UNIT / link->acked > LINK_ETX_MAX)
+		sample = LINK_ETX_MAX;
+	else
+		sample = (uint32_t)link->tx * LINK_ETX_UNIT / link->acked;
+	if (!link->etx_valid) {
+		// start from the guess, a single window is not much to go on
+		link->etx = link->rssi_valid ? LinkEstimatorRssiEtx(LinkEstimatorGetRssi(estimator, id)) : sample;
+		link->etx_valid = true;
+	}
+	link->etx = ((uint32_t)link->etx * (LINK_ETX_EWMA - 1) + sample) / LINK_ETX_EWMA;
+	LinkEstimatorAdjustPower(link, sample);
+	printf("ETX of link to %d: %d/%d (%d tx, %d acked), power margin %d dB\n", id, link->etx, LINK_ETX_UNIT, link->tx, link->acked, link->power_margin);
+	link->tx = 0;
+	link->acked = 0;
+}
+
+int16_t LinkEstimatorGetRssi(LinkEstimator *estimator, uint8_t id)
+{
+	return estimator->links[id - 1].rssi / LINK_RSSI_EWMA;
+}
+
+bool LinkEstimatorUsable(LinkEstimator *estimator, uint8_t id)
+{
+	return estimator->links[id - 1].rssi_valid && LinkEstimatorGetRssi(estimator, id) >= IGNORE_RSSI_BELOW;
+}
+
+uint16_t LinkEstimatorCost(LinkEstimator *estimator, uint8_t id)
+{
+	LinkEstimate *link = &estimator->links[id - 1];
+
+	if (link->etx_valid)
+		return link->etx;
+	if (link->rssi_valid)
+		return LinkEstimatorRssiEtx(LinkEstimatorGetRssi(estimator, id));
+	return LINK_ETX_MAX;
+}
+
+int8_t LinkEstimatorTxPower(LinkEstimator *estimator, uint8_t id)
+{
+	LinkEstimate *link = &estimator->links[id - 1];
+	int16_t power;
+
+	if (!LINK_POWER_CONTROL || !link->rssi_valid)
+		return TX_POWER;
+	// path loss from the keep alives, which are sent with TX_POWER
+	power = TX_POWER - LinkEstimatorGetRssi(estimator, id) + LINK_POWER_TARGET_RSSI + link->power_margin;
+	if (power < LINK_POWER_MIN)
+		return LINK_POWER_MIN;
+	if (power > TX_POWER)
+		return TX_POWER;
+	return (int8_t)power;
+}
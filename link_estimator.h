@@ -0,0 +1,61 @@
+/**@file link_estimator.h*/
+
+#ifndef LINK_ESTIMATOR_H
+#define LINK_ESTIMATOR_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Link quality estimate of one neighbour.*/
+typedef struct
+{
+	int16_t rssi;/**<EWMA of the RSSI of its keep alives, times LINK_RSSI_EWMA.*/
+	uint16_t etx;/**<EWMA of the expected number of transmissions, LINK_ETX_UNIT is one transmission.*/
+	uint8_t tx;/**<Transmissions to it in the current window.*/
+	uint8_t acked;/**<Acknowledged packets in the current window.*/
+	bool rssi_valid;/**<True once a keep alive was heard.*/
+	bool etx_valid;/**<True once a window of transmissions was completed.*/
+	uint8_t power_margin;/**<dB over LINK_POWER_TARGET_RSSI we send with, follows the ETX of every window.*/
+}LinkEstimate;
+
+/**@brief Link estimator.
+ * The RSSI of keep alives is averaged and used to admit links, and to guess the ETX
+ * of a link we didn't send anything over yet. Once we sent over it, the ETX is measured
+ * from the acknowledgements of runicast and unicast transmissions, in windows of
+ * LINK_ETX_WINDOW transmissions. The ETX is the link cost, lower is better.
+ * The transmission power of a link is the lowest that gets its packets through: the
+ * path loss seen on keep alives plus a margin that grows while the ETX is too high.*/
+typedef struct
+{
+	LinkEstimate links[TOTAL_NODES];/**<Estimate of neighbour X.*/
+}LinkEstimator;
+
+// forgets every neighbour
+void LinkEstimatorInit(LinkEstimator *estimator);
+
+// forgets a neighbour, e.g. when it went down
+void LinkEstimatorReset(LinkEstimator *estimator, uint8_t id);
+
+// adds the RSSI of a keep alive
+void LinkEstimatorRssi(LinkEstimator *estimator, uint8_t id, int16_t rssi);
+
+// adds the outcome of a packet sent with the given number of transmissions
+void LinkEstimatorTx(LinkEstimator *estimator, uint8_t id, uint8_t transmissions, bool acked);
+
+// returns the averaged RSSI
+int16_t LinkEstimatorGetRssi(LinkEstimator *estimator, uint8_t id);
+
+// returns true if the averaged RSSI is good enough to use the link
+bool LinkEstimatorUsable(LinkEstimator *estimator, uint8_t id);
+
+// returns the cost of the link, LINK_ETX_UNIT for a perfect one
+uint16_t LinkEstimatorCost(LinkEstimator *estimator, uint8_t id);
+
+// returns the transmission power (dBm) for a unicast to the neighbour
+int8_t LinkEstimatorTxPower(LinkEstimator *estimator, uint8_t id);
+
+#endif /* LINK_ESTIMATOR_H */
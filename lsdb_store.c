@@ -0,0 +1,117 @@
+
+#include "lsdb_store.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+/**@brief Record buffer, too big for the stack.*/
+static struct lsdb_record record;
+
+static uint16_t LsdbStoreFletcher16(const uint8_t *data, uint16_t len)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	uint16_t i;
+
+	for (i = 0; i < len; i++) {
+		sum1 = (sum1 + data[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return (sum2 << 8) | sum1;
+}
+
+// checksum over what makes a checkpoint necessary: links up/down and sequence numbers
+static uint16_t LsdbStoreTopology(struct link_state_database *lsdb, uint8_t sequence_number)
+{
+	uint16_t sum1 = sequence_number;
+	uint16_t sum2 = sequence_number;
+	uint8_t i, j;
+
+	for (i = 0; i < TOTAL_NODES; i++) {
+		sum1 = (sum1 + lsdb->sequence_numbers[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+		for (j = 0; i < LSDB_ROWS && j < TOTAL_NODES; j++) {
+			sum1 = (sum1 + (lsdb->node_links_cost[i][j] > 0 ? i * TOTAL_NODES + j + 1 : 0)) % 255;
+			sum2 = (sum2 + sum1) % 255;
+		}
+	}
+	return (sum2 << 8) | sum1;
+}
+
+uint8_t LsdbStoreSave(LsdbStore *store, struct link_state_database *lsdb, uint8_t sequence_number)
+{
+	int fd;
+	int len;
+	uint16_t topology = LsdbStoreTopology(lsdb, sequence_number);
+
+	if (store->records > 0 && topology == store->topology)
+		return LSDB_STORE_UNCHANGED;
+
+	// erase the log only when it is full
+	if (store->records >= LSDB_STORE_MAX_RECORDS) {
+		cfs_remove(LSDB_STORE_FILE);
+		store->records = 0;
+	}
+
+	record.magic = LSDB_STORE_MAGIC;
+	record.total_nodes = TOTAL_NODES;
+	record.rows = LSDB_ROWS;
+	record.sequence_number = sequence_number;
+	memcpy(record.sequence_numbers, lsdb->sequence_numbers, sizeof(record.sequence_numbers));
+	record.age = lsdb->age;
+	memcpy(record.node_links_cost, lsdb->node_links_cost, sizeof(record.node_links_cost));
+	record.checksum = LsdbStoreFletcher16((uint8_t *)&record, offsetof(struct lsdb_record, checksum));
+
+	fd = cfs_open(LSDB_STORE_FILE, CFS_WRITE | CFS_APPEND);
+	if (fd < 0)
+		return LSDB_STORE_FAIL;
+	len = cfs_write(fd, &record, sizeof(record));
+	cfs_close(fd);
+	if (len != sizeof(record))
+		return LSDB_STORE_FAIL;
+
+	store->topology = topology;
+	store->records++;
+	printf("LSDB checkpoint %d written (%d bytes)\n", store->records, sizeof(record));
+	return LSDB_STORE_SUCCESS;
+}
+
+uint8_t LsdbStoreLoad(LsdbStore *store, struct link_state_database *lsdb, uint8_t *sequence_number)
+{
+	int fd;
+	int len;
+	bool found = false;
+
+	store->records = 0;
+	fd = cfs_open(LSDB_STORE_FILE, CFS_READ);
+	if (fd < 0)
+		return LSDB_STORE_FAIL;
+
+	// the newest valid record wins, a torn last write is skipped
+	while ((len = cfs_read(fd, &record, sizeof(record))) == sizeof(record)) {
+		store->records++;
+		if (record.magic != LSDB_STORE_MAGIC || record.total_nodes != TOTAL_NODES || record.rows != LSDB_ROWS)
+			continue;
+		if (record.checksum != LsdbStoreFletcher16((uint8_t *)&record, offsetof(struct lsdb_record, checksum)))
+			continue;
+		memcpy(lsdb->sequence_numbers, record.sequence_numbers, sizeof(record.sequence_numbers));
+		memcpy(lsdb->node_links_cost, record.node_links_cost, sizeof(record.node_links_cost));
+		lsdb->age = record.age;
+		*sequence_number = record.sequence_number;
+		found = true;
+	}
+	cfs_close(fd);
+
+	// a torn record at the end would misalign everything appended after it
+	if (len > 0) {
+		printf("LSDB log has a torn record, erasing it\n");
+		cfs_remove(LSDB_STORE_FILE);
+		store->records = 0;
+	}
+
+	if (!found)
+		return LSDB_STORE_FAIL;
+	store->topology = LsdbStoreTopology(lsdb, *sequence_number);
+	printf("LSDB restored from checkpoint %d\n", store->records);
+	return LSDB_STORE_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/**@file lsdb_store.h*/
+
+#ifndef LSDB_STORE_H
+#define LSDB_STORE_H
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**Return code for store failure.*/
+#ifndef LSDB_STORE_FAIL
+#define LSDB_STORE_FAIL 0
+#endif
+
+/**Return code for store success.*/
+#ifndef LSDB_STORE_SUCCESS
+#define LSDB_STORE_SUCCESS 1
+#endif
+
+/**Return code if nothing changed since the last checkpoint, so nothing was written.*/
+#ifndef LSDB_STORE_UNCHANGED
+#define LSDB_STORE_UNCHANGED 2
+#endif
+
+/**@brief Checkpoint of the LSDB as written to flash.*/
+struct lsdb_record{
+	uint8_t magic;/**<LSDB_STORE_MAGIC, to find out if the record was written at all.*/
+	uint8_t total_nodes;/**<TOTAL_NODES of the firmware that wrote the record.*/
+	uint8_t rows;/**<LSDB_ROWS of the firmware that wrote the record.*/
+	uint8_t sequence_number;/**<My own sequence number.*/
+	uint8_t sequence_numbers[TOTAL_NODES];/**<Sequence numbers per node.*/
+	uint16_t age;/**<Age of the LSDB.*/
+	uint16_t node_links_cost[LSDB_ROWS][TOTAL_NODES];/**<The links.*/
+	uint16_t checksum;/**<Fletcher-16 over all fields above.*/
+};
+
+/**@brief Log of LSDB checkpoints in the on-chip flash.
+ * Checkpoints are appended to one CFS file, which is only erased when it
+ * holds LSDB_STORE_MAX_RECORDS of them. To spare the flash, a checkpoint is only
+ * written if links came or went, or sequence numbers changed. Changed link
+ * costs alone are saved with the next checkpoint.*/
+typedef struct
+{
+	uint16_t topology;/**<Checksum of links and sequence numbers of the last checkpoint.*/
+	uint8_t records;/**<Number of records in the log file.*/
+}LsdbStore;
+
+// writes a checkpoint of the lsdb and my sequence number, if the topology changed
+// returns LSDB_STORE_UNCHANGED if nothing had to be written, LSDB_STORE_FAIL on a flash error
+uint8_t LsdbStoreSave(LsdbStore *store, struct link_state_database *lsdb, uint8_t sequence_number);
+
+// restores the lsdb and my sequence number from the newest valid checkpoint
+// returns LSDB_STORE_FAIL if there is none
+uint8_t LsdbStoreLoad(LsdbStore *store, struct link_state_database *lsdb, uint8_t *sequence_number);
+
+#endif /* LSDB_STORE_H */
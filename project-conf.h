@@ -29,24 +29,160 @@
 
 
 /**
- * A global variable defining the period
- * to transmit a keep alivem message.
+ * Longest interval between keep alive messages, reached when the neighbourhood is stable.
+ * Keep alives are scheduled by a Trickle timer, see trickle.h.
  * In seconds.
  */
-#define KEEP_ALIVE_PERIOD 100*CLOCK_SECOND
+#define KEEP_ALIVE_PERIOD (64*CLOCK_SECOND)
+
+/**
+ * Number of times the keep alive interval doubles, from TRICKLE_IMIN up to KEEP_ALIVE_PERIOD.
+ */
+#define TRICKLE_MAX_DOUBLINGS 5
+
+/**
+ * Shortest interval between keep alive messages, used after booting and after
+ * a topology change, so new neighbours and lost links are picked up quickly.
+ * Also the period with which we check if a neighbour is down.
+ */
+#define TRICKLE_IMIN ((KEEP_ALIVE_PERIOD) >> TRICKLE_MAX_DOUBLINGS)
+
+/**
+ * A keep alive is not sent if we heard this many consistent ones
+ * (from neighbours that know us and agree on the LSDB) in the same interval.
+ */
+#define TRICKLE_K 2
+
+/**
+ * Maximum number of keep alives suppressed in a row.
+ * Bounds the time a neighbour has to wait for our next keep alive.
+ */
+#define TRICKLE_MAX_SUPPRESSED 1
+
+/**
+ * Number of keep alives in a row that can get lost before a neighbour
+ * considers us down. Every keep alive advertises how long this takes at most.
+ */
+#define TRICKLE_MISSED_HELLOS 1
 
 /**
  * A global variable defining the period
  * after which a link is considered to be down
- * if no HELLO_PACKET received in DOWN_PERIOD
+ * if no HELLO_PACKET received in DOWN_PERIOD.
+ * Only used for neighbours that didn't advertise their own liveness yet,
+ * and after a reboot for the links we restored.
  * In seconds.
  */
-#define DOWN_PERIOD 200*CLOCK_SECOND
+#define DOWN_PERIOD (200*CLOCK_SECOND)
 
 /**
  * Define the frequency with which we sense data from the sensors.
  */
-#define SENSOR_READ_INTERVAL 105*CLOCK_SECOND
+#define SENSOR_READ_INTERVAL (105*CLOCK_SECOND)
+
+/**
+ * Number of ADC samples taken for every sensor reading, see sampling.h.
+ */
+#define SAMPLING_OVERSAMPLE 8
+
+/**
+ * Weight of the average of the ADC readings. A new reading counts 1/SAMPLING_EWMA.
+ */
+#define SAMPLING_EWMA 4
+
+/**
+ * Fractional bits of the average of the ADC readings.
+ */
+#define SAMPLING_FRACTION_BITS 4
+
+/**
+ * A reading further than this (raw 12 bit ADC counts) from the average is taken as it is,
+ * instead of being averaged in.
+ */
+#define SAMPLING_STEP 200
+
+/**
+ * Number of sensor readings sent together in one data packet, see sample_batch.h.
+ * 1 sends every reading on its own.
+ */
+#define SAMPLE_BATCH_SIZE 4
+
+/**
+ * A batch is sent with the first reading after its oldest sample got this old, even if it isn't full.
+ */
+#define SAMPLE_BATCH_MAX_AGE (300*CLOCK_SECOND)
+
+/**
+ * Bytes for the encoded readings of a batch after the first one. Two per reading are usually enough.
+ */
+#define SAMPLE_BATCH_BYTES 16
+
+/**
+ * Windows (seconds) of the statistics the sink keeps per sensor, see summary.h.
+ * They roll on in steps of 1/SUMMARY_BUCKETS of their length.
+ */
+#define SUMMARY_WINDOWS {900, 3600}
+
+/**
+ * Number of windows in SUMMARY_WINDOWS.
+ */
+#define SUMMARY_WINDOW_COUNT 2
+
+/**
+ * Steps a summary window is split in. More steps roll more smoothly and take more memory.
+ */
+#define SUMMARY_BUCKETS 4
+
+/**
+ * Interval with which the sink sends the summaries of all sensors to the host.
+ * The host changes it with "summary.interval <seconds>", 0 stops them.
+ */
+#define SUMMARY_INTERVAL (60*CLOCK_SECOND)
+
+/**
+ * If true the sink also prints every reading it gets and the path it took.
+ * The host changes it with "summary.raw on" and "summary.raw off".
+ */
+#define SUMMARY_RAW false
+
+/**
+ * If true every data packet carries the time it waited in every node on its path, and the
+ * sink keeps latency distributions per sensor, see latency.h.
+ * Costs 4 + 2*TOTAL_NODES bytes per data packet. All motes need the same setting.
+ */
+#define LATENCY_TRACE true
+
+/**
+ * Buckets of a latency histogram. Bucket 0 holds latencies below LATENCY_RESOLUTION,
+ * every further one twice the range of the one before. The last one holds all longer latencies.
+ */
+#define LATENCY_BUCKETS 14
+
+/**
+ * Upper bound of the first latency bucket (ms).
+ */
+#define LATENCY_RESOLUTION 16
+
+/**
+ * Hops the sink keeps a latency distribution of per sensor. Hops further from the sensor count to the last one.
+ */
+#define LATENCY_HOPS 4
+
+/**
+ * Paths the sink keeps delivery counts of per sensor, see delivery.h.
+ */
+#define DELIVERY_PATHS 4
+
+/**
+ * Topology events a node counts the flooding cost of, see flood_cost.h. The sink keeps the totals of as many.
+ */
+#define FLOOD_EVENTS 8
+
+/**
+ * A node reports the flooding cost of a topology event to the sink once it didn't send or
+ * receive a LSA of the event for this long.
+ */
+#define FLOOD_REPORT_DELAY (30*CLOCK_SECOND)
 
 /**
  * This defines the total number of nodes.\n
@@ -56,15 +192,81 @@
 #define TOTAL_NODES 13
 
 /**
- * Node id of the sink.
+ * Node id of the first sink. It is the time reference of the network.
  */
 #define SINK_ID 1
 
+/**
+ * Node ids of all sinks, every one connected to a GUI.
+ * Data goes to the sink with the cheapest path, e.g. {SINK_ID, 13}.
+ * @warning Sinks need odd node ids, like bridges.
+ */
+#define SINK_IDS {SINK_ID}
+
+/**Role image that runs on every node id, the role follows from the node id.*/
+#define NODE_ROLE_ANY 0
+/**Role image of a sink.*/
+#define NODE_ROLE_SINK 1
+/**Role image of a bridge.*/
+#define NODE_ROLE_BRIDGE 2
+/**Role image of a sensor mote.*/
+#define NODE_ROLE_SENSOR 3
+
+/**
+ * Role the firmware is built for. The images built from sink.c, bridge.c and sensor.c
+ * set it, so the code of the other roles is compiled out. routing.c runs any role.
+ * @warning The node id still has to fit the role (odd for sinks and bridges, even for sensor motes).
+ */
+#ifndef NODE_ROLE
+#define NODE_ROLE NODE_ROLE_ANY
+#endif
+
+#if NODE_ROLE == NODE_ROLE_SENSOR
+/**Sensor motes only queue their own LSAs and readings.*/
+#define BUFFER_SIZE 4
+/**The pool holds what the queues hold, but rarely all at once.*/
+#define BUFFER_POOL_SIZE 6
+/**Own LSAs and readings each keep room, no LSDB is sent from a sensor mote.*/
+#define BUFFER_POOL_RESERVED {2, 2, 0}
+#endif
+
+#if NODE_ROLE == NODE_ROLE_ANY || NODE_ROLE == NODE_ROLE_SINK
+/**Sensors the sink keeps statistics of, one per even node id.*/
+#define SINK_SENSORS (TOTAL_NODES/2)
+/**Other nodes the sink drops resent data packets of, one per odd node id.*/
+#define SINK_REPORTERS ((TOTAL_NODES+1)/2)
+#else
+#define SINK_SENSORS 1
+#define SINK_REPORTERS 1
+#endif
+
 /**
  * Pre backoff timer when the network first goes live\n.
+ * The node then waits for its next transmit slot, so nodes that are powered on
+ * together don't ask for LSDB ages at the same time.
  * @warning Needs to be less than the KEEP_ALIVE_PERIOD
  */
-#define INIT_PRE_BACKOFF_PERIOD (10 + random_rand()%(TOTAL_NODES*2))*CLOCK_SECOND
+#define INIT_PRE_BACKOFF_PERIOD (10*CLOCK_SECOND)
+
+/**
+ * Length of a transmit slot.\n
+ * Long enough for one frame with the channel check rate above (ContikiMAC strobes for up to 1/16 s).
+ */
+#define SLOT_DURATION (CLOCK_SECOND/8)
+
+/**
+ * Number of slots in a frame of the transmit schedule.\n
+ * Nodes within two hops of each other get different slots, as long as
+ * there are not more than SLOT_FRAME_LENGTH of them.
+ */
+#define SLOT_FRAME_LENGTH 8
+
+/**
+ * Maximum random jitter at the start of a transmit slot.
+ * Lets CSMA separate nodes that ended up in the same slot.
+ * @warning Needs to be smaller than SLOT_DURATION and at least 1.
+ */
+#define SLOT_JITTER (SLOT_DURATION/4)
 
 /**
  * When this timer expires we initiate the message sequence to get the LSDB from
@@ -72,7 +274,7 @@
  * @warning Needs to be less than the KEEP_ALIVE_PERIOD.
  * @warning Higher than the PRE_BACKOFF_PERIOD
  */
-#define GET_LSDB_PERIOD (TOTAL_NODES*2+5)*CLOCK_SECOND
+#define GET_LSDB_PERIOD ((TOTAL_NODES*2+5)*CLOCK_SECOND)
 
 /**
  * Time To Live. Max number of nodes a data packet can traverse before being discarded.
@@ -81,6 +283,127 @@
  */
 #define TTL 5
 
+/**
+ * Sync depth of a node that has no time reference yet.\n
+ * The sink is the time reference of the network (depth 0), every other node
+ * takes over the network time of the neighbour with the lowest depth it hears
+ * a keep alive from, so the time spreads out like a tree rooted at the sink.
+ */
+#define TIMESYNC_UNSYNCED 255
+
+/**
+ * How often we check if the LSDB has to be checkpointed to flash.
+ * A checkpoint is only written if links or sequence numbers changed.
+ */
+#define LSDB_CHECKPOINT_PERIOD (60*CLOCK_SECOND)
+
+/**
+ * Number of checkpoints appended to the LSDB log file before it is erased and started over.
+ */
+#define LSDB_STORE_MAX_RECORDS 16
+
+/**
+ * CFS file name of the LSDB log.
+ */
+#define LSDB_STORE_FILE "lsdb"
+
+/**
+ * Marks a written LSDB checkpoint. Changed whenever the meaning of the stored link costs changes.
+ */
+#define LSDB_STORE_MAGIC 0xA6
+
+/**
+ * After restoring the LSDB my sequence number is advanced by this much, since
+ * LSAs may have been sent after the last checkpoint. Otherwise our neighbours would
+ * ignore our next LSAs as old.
+ */
+#define LSDB_STORE_SEQ_GAP 5
+
+/**
+ * Number of keep alives in a row from a neighbour with a different LSDB digest,
+ * before we ask the neighbour for its LSDB to repair ours.\n
+ * Gives LSAs that are still being flooded a chance to arrive first.
+ */
+#define LSDB_DIGEST_MISMATCH_LIMIT 2
+
+/**
+ * Time we give a neighbour to send us the next link of the LSDB we asked for, before we ask again.
+ */
+#define LSDB_REPAIR_TIMEOUT (60*CLOCK_SECOND)
+
+/**
+ * Stub node mode. If 1, sensor motes (even node ids) are stub nodes:
+ * they only keep their own uplinks and pick the best one as parent.
+ * Bridges don't flood LSAs about other links to them, and they don't store or
+ * forward such LSAs if they get one anyway.
+ */
+#define STUB_NODE_MODE 1
+
+/**
+ * 1 in the image of a stub node, a sensor mote built with STUB_NODE_MODE.
+ * Its LSDB only has its own row, its uplinks. There is no routing table to compute,
+ * no LSDB digest to compare and no LSDB to ask for or send.
+ */
+#if NODE_ROLE == NODE_ROLE_SENSOR && STUB_NODE_MODE
+#define STUB_IMAGE 1
+#else
+#define STUB_IMAGE 0
+#endif
+
+/**
+ * Rows of the link costs in the LSDB, one per source node. See STUB_IMAGE.
+ */
+#if STUB_IMAGE
+#define LSDB_ROWS 1
+#else
+#define LSDB_ROWS TOTAL_NODES
+#endif
+
+/**
+ * Routing modes, see ROUTING_MODE.
+ */
+#define ROUTING_MODE_LINK_STATE 0
+#define ROUTING_MODE_COLLECTION_TREE 1
+
+/**
+ * ROUTING_MODE_LINK_STATE: links are flooded as LSAs, every node keeps the LSDB and
+ * computes its routes from it.\n
+ * ROUTING_MODE_COLLECTION_TREE: only for data to the sink. Keep alives carry the path cost
+ * to the sink and every node picks the neighbour with the cheapest path as parent. No LSAs
+ * are sent. Loops are detected from the path of data packets and from the path cost of their sender.
+ */
+#define ROUTING_MODE ROUTING_MODE_LINK_STATE
+
+/**
+ * In collection tree mode, a new parent has to be at least this much cheaper than the current one.
+ */
+#define TREE_PARENT_SWITCH LINK_ETX_UNIT
+
+/**
+ * A keep alive is left out if every neighbour got a LSA or unicast from us since the last one,
+ * since those carry the liveness too (see struct frame_ext). After this many left out in a row,
+ * one is sent anyway, for the time sync and the neighbour list.
+ */
+#define KEEP_ALIVE_MAX_PIGGYBACKED 4
+
+/**
+ * Occupancy of the data queue (percent) at which a bridge counts as congested.
+ * Neighbours then send over other next hops and sensor motes behind it report less often.
+ */
+#define BACKPRESSURE_HIGH 75
+
+/**
+ * Occupancy of the data queue (percent) at which a congested bridge counts as free again.
+ * @warning Needs to be lower than BACKPRESSURE_HIGH.
+ */
+#define BACKPRESSURE_LOW 25
+
+/**
+ * A sensor mote doubles its read interval for every reading its next hop is congested,
+ * at most this many times. It halves it again for every reading it isn't.
+ */
+#define BACKPRESSURE_MAX_BACKOFF 3
+
 /**
  * Group Channel
  */
@@ -94,10 +417,134 @@
 /**
  * In order to make it a multi-hop network in the small exam room we have to ignore
  * packet establishing links below a certain rssi.
- * Unfortunately this introduces instabilities and false positives/negatives.
+ * Compared against the average RSSI of a neighbour (see link_estimator.h), so a
+ * single weak or strong packet doesn't make a link come and go.
  */
 #define IGNORE_RSSI_BELOW -70
 
+/**
+ * Links with an average RSSI above this are assumed to need a single transmission per packet,
+ * until we measured their ETX.
+ */
+#define LINK_RSSI_GOOD -60
+
+/**
+ * If true, unicasts and runicasts are sent with the lowest power that still reaches the
+ * neighbour (see LinkEstimatorTxPower()). Keep alives always go out with TX_POWER, the radio
+ * has one power for all frames, so packets with another power wait until it is free.
+ */
+#define LINK_POWER_CONTROL true
+
+/**
+ * RSSI (dBm) we want our unicasts to arrive with, before the margin a link earned.
+ * The path loss is taken from the keep alives of the neighbour, sent with TX_POWER.
+ */
+#define LINK_POWER_TARGET_RSSI -85
+
+/**
+ * Lowest transmission power (dBm) of a unicast.
+ */
+#define LINK_POWER_MIN -24
+
+/**
+ * A window of transmissions with an ETX above this raises the power margin of the link by
+ * LINK_POWER_STEP dB, a window without retransmissions lowers it by 1 dB.
+ */
+#define LINK_POWER_TARGET_ETX (LINK_ETX_UNIT*5/4)
+
+/**
+ * dB the power margin of a link grows by when its delivery is too bad.
+ */
+#define LINK_POWER_STEP 3
+
+/**
+ * Largest power margin (dB) of a link.
+ */
+#define LINK_POWER_MAX_MARGIN 18
+
+/**
+ * Link cost of a perfect link, one transmission per packet (ETX 1).
+ * Link costs add up along a path, lower is better.
+ */
+#define LINK_ETX_UNIT 16
+
+/**
+ * Highest link cost, for links that don't deliver at all.
+ */
+#define LINK_ETX_MAX (8*LINK_ETX_UNIT)
+
+/**
+ * Number of transmissions to a neighbour after which we compute a new ETX sample.
+ */
+#define LINK_ETX_WINDOW 4
+
+/**
+ * Weight of the RSSI average. A new keep alive counts 1/LINK_RSSI_EWMA.
+ */
+#define LINK_RSSI_EWMA 8
+
+/**
+ * Weight of the ETX average. A new sample counts 1/LINK_ETX_EWMA.
+ */
+#define LINK_ETX_EWMA 4
+
+/**
+ * A link cost change is only advertised if it is bigger than this percentage.
+ * Otherwise every keep alive would flood a new LSA.
+ */
+#define LINK_COST_HYSTERESIS 25
+
+/**
+ * Penalty a link gets every time it goes down, see flap_damping.h.
+ */
+#define FLAP_PENALTY 1000
+
+/**
+ * A link with at least this penalty is not advertised again when it comes back up.
+ * With the values here that is the case if a link went down 3 times, about 2 minutes apart.
+ */
+#define FLAP_SUPPRESS 2000
+
+/**
+ * A suppressed link is advertised again once its penalty decayed below this.
+ */
+#define FLAP_REUSE 750
+
+/**
+ * Upper bound of the penalty. Bounds the time a link stays suppressed
+ * to a bit less than 3 half lives after its last flap.
+ */
+#define FLAP_MAX_PENALTY 5000
+
+/**
+ * Time after which the penalty of a link is halved.
+ */
+#define FLAP_HALF_LIFE (300*CLOCK_SECOND)
+
+/**
+ * Number of unicasts in a row the MAC layer couldn't deliver to a neighbour,
+ * before the neighbour is considered down. A runicast that runs out of
+ * retransmissions is enough on its own.
+ */
+#define LINK_SUSPECT_LIMIT 3
+
+/**
+ * Data is spread over all next hops whose path to the sink is at most this
+ * many percent more expensive than the shortest one.
+ */
+#define MULTIPATH_STRETCH 20
+
+/**
+ * Battery value (mV) below which a next hop gets the lowest share of the data.
+ */
+#define MULTIPATH_BATTERY_FLOOR 2000
+
+/**
+ * Every MULTIPATH_BATTERY_STEP mV above MULTIPATH_BATTERY_FLOOR give a next hop one more share of the data.
+ * Coarse, so small changes of the battery readings don't move flows around.
+ */
+#define MULTIPATH_BATTERY_STEP 100
+
 /**
  * Color LEDS_RED for incoming packets (broadcast/unicast/runicast).
  */
@@ -17,20 +17,41 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <project-conf.h>
 #include <buffer.c>
+#include <schedule.c>
+#include <trickle.c>
+#include <link_estimator.c>
+#include <flap_damping.c>
+#if STUB_IMAGE
+#include <dijkstra.h>
+#else
+#include <dijkstra.c>
+#endif
+#include <lsdb_store.c>
+#include <sample_batch.c>
+#include <sampling.c>
+#include <summary.c>
+#include <latency.c>
+#include <delivery.c>
+#include <flood_cost.c>
 #include <sensor_conversion_functions.h>
 
 //***** TIMERS *****
 /**
  * @brief Timer to send keep alive packets.\n
- * Used to indicate that a node is still alive.*/
+ * Used to indicate that a node is still alive.
+ * Driven by the Trickle timer, see trickle.h.*/
 static struct etimer keep_alive_timer;
 /**
- * @brief If down_timer expires and no keep_alive packets
- * received in that period a node is considered down.*/
+ * @brief When down_timer expires we check if a neighbour missed the
+ * keep alives it promised, then it is considered down.*/
 static struct etimer down_timer;
+
+/**@brief Deadline for the next packet of neighbour X, before it is considered down.*/
+static struct timer liveness_timer[TOTAL_NODES];
 /**
  * @brief Timer for a intial pre-backoff to avoid congestion and
  * collisions when nodes first go live.*/
@@ -45,6 +66,12 @@ static struct etimer get_lsdb_timer;
 /**@brief When expired we read an adc3 value and send a data packet containing sensor data.*/
 static struct etimer sensor_reading_timer;
 
+/**@brief When expired we checkpoint the LSDB to flash, if it changed.*/
+static struct etimer checkpoint_timer;
+
+/**@brief When expired the sink sends the summaries of all sensors to the host.*/
+static struct etimer summary_timer;
+
 //***** CONNECTION STUFF *****
 /** @brief Instance of a broadcast connection.*/
 static struct broadcast_conn broadcast;
@@ -59,84 +86,1446 @@ static struct runicast_conn runicast;
 /** @brief Keep alive packet for reception.*/
 static struct keep_alive_packet rx_ka_pkt;
 
-/** @brief Keep alive packet for transimission.*/
-static struct keep_alive_packet tx_ka_pkt;
+/** @brief Keep alive packet for transimission.*/
+static struct keep_alive_packet tx_ka_pkt;
+
+/** @brief Link State Adverisment packet for reception.*/
+static struct lsa rx_lsa_pkt;
+
+/**@brief Unicast packet for reception.*/
+static struct unicast_packet rx_uni_pkt;
+
+/**@brief Filter of the ADC3 readings, most sensor motes convert these.*/
+static Sampling adc3_sampling;
+
+/**@brief Readings of a sensor mote not sent yet.*/
+static SampleBatch batch;
+
+/**@brief True if the readings in batch have a network time.*/
+static bool batch_timestamp_valid;
+
+/**@brief Statistics of the readings of sensor X, sensor 2X on the sink.*/
+static Summary summaries[SINK_SENSORS];
+
+/**@brief Latencies of the data packets of sensor X, sensor 2X on the sink.*/
+static LatencyStats latency[SINK_SENSORS];
+
+/**@brief Delivery of the data packets of sensor X, sensor 2X on the sink.*/
+static Delivery delivery[SINK_SENSORS];
+
+/**@brief Data packets of node 2X+1 received lately on the sink, its flood reports count for no delivery.*/
+static DeliverySeen reporters_seen[SINK_REPORTERS];
+
+/**@brief Sequence number of our next data packet.*/
+static uint16_t data_seq;
+
+/**@brief Boot epoch sent with our data packets, so the sink can tell a restart from duplicates.*/
+static uint16_t data_epoch;
+
+/**@brief Flooding cost of the topology events we took part in.*/
+static FloodCost flood_cost;
+
+/**@brief Flooding cost of topology events summed over the nodes that reported it, on the sink.*/
+static FloodCost flood_totals;
+
+/**@brief Node of the topology event the LSAs enqueued now are flooded for.*/
+static uint8_t flood_origin;
+
+/**@brief Number of the topology event the LSAs enqueued now are flooded for.*/
+static uint8_t flood_id;
+
+/**@brief Number of our last topology event.*/
+static uint8_t flood_events;
+
+/**@brief Node of the topology event of the LSA runicast is sending, 0 if it isn't flooded.*/
+static uint8_t flood_inflight_origin;
+
+/**@brief Number of the topology event of the LSA runicast is sending.*/
+static uint8_t flood_inflight_id;
+
+/**@brief Interval of the summaries sent to the host, 0 if they are off. Set by the host.*/
+static clock_time_t summary_interval = SUMMARY_INTERVAL;
+
+/**@brief True if the sink prints every reading too. Set by the host.*/
+static bool summary_raw = SUMMARY_RAW;
+
+//***** MISC VARIABLES*****
+/**@brief If forward True we have received an LCA and do reliable forwarding to neighbours.
+ * If forward False we generated the packet and reliably flood it to our neighbours.*/
+static bool forward;
+
+/**@brief Transmit queues of all traffic classes, emptied by the send process.*/
+static Buffer buffer;
+
+/**@brief Our transmit slots.*/
+static Schedule schedule;
+
+/**@brief Schedules our keep alives.*/
+static Trickle trickle;
+
+/**@brief Liveness (seconds) advertised in the last keep alive of neighbour X. 0 if none yet.*/
+static uint16_t neighbour_liveness[TOTAL_NODES];
+
+/**@brief Link quality of our neighbours, gives the cost of our links.*/
+static LinkEstimator estimator;
+
+/**@brief Battery value advertised in the last keep alive of neighbour X.*/
+static uint16_t neighbour_battery[TOTAL_NODES];
+
+/**@brief Data queue occupancy (percent) advertised in the last keep alive of neighbour X.*/
+static uint8_t neighbour_load[TOTAL_NODES];
+
+/**@brief Bit i set if neighbour i+1 acknowledged a packet from us since our last keep alive opportunity.*/
+static uint16_t piggybacked;
+
+/**@brief Keep alives left out in a row, since every neighbour got a packet from us.*/
+static uint8_t hellos_piggybacked;
+
+/**@brief True while our data queue is above BACKPRESSURE_HIGH, until it falls to BACKPRESSURE_LOW.*/
+static bool congested;
+
+/**@brief A sensor mote reads every SENSOR_READ_INTERVAL << sensor_backoff, while its next hop is congested.*/
+static uint8_t sensor_backoff;
+
+/**@brief Keeps flapping links of ours from flooding LSAs.*/
+static FlapDamping damping;
+
+/**@brief Failed transmissions in a row to neighbour X, see link_failed().*/
+static uint8_t tx_failures[TOTAL_NODES];
+
+/**@brief Path cost to the sink advertised by neighbour X (collection tree mode). DIJKSTRA_INFINITY if none.*/
+static uint16_t neighbour_path_cost[TOTAL_NODES];
+
+/**@brief Our parent in the collection tree. 0 if none.*/
+static uint8_t tree_parent;
+
+/**@brief Our path cost to the sink over tree_parent.*/
+static uint16_t tree_cost = DIJKSTRA_INFINITY;
+
+/**@brief Node ID.*/
+static uint8_t node_id;
+
+/**@brief ID of sender.*/
+static uint8_t sender_id;
+
+/**@brief Global destination variable used by various functions
+ * to construct a link address and send a (r)/unicast.*/
+static linkaddr_t dst_t;
+
+/**@brief List of received ages when first going live.*/
+static uint8_t rx_ages[TOTAL_NODES];
+
+/**@brief Next hop and backup next hop per destination, computed from the LSDB.*/
+static RoutingTable routing_table;
+
+/**@brief True if the LSDB changed since the routing table was computed.*/
+static bool routes_dirty = true;
+
+/**@brief Last data packet we sent, kept out of the pool until the MAC layer reported back.
+ * Sent again over the backup next hop if it couldn't be delivered.*/
+static BufferEntry *last_data;
+
+/**@brief Next hop of last_data. 0 once the MAC layer reported back.*/
+static uint8_t last_data_to;
+
+/**@brief Receiver of the unicast the MAC layer didn't report back on yet, 0 if none.
+ * Unicasts go out one at a time, so every report is about the one we sent last.*/
+static uint8_t unicast_to;
+
+/**@brief Posted to the routing process when last_data couldn't be delivered.*/
+static process_event_t data_undelivered_event;
+
+/**@brief My sequence number, that i attach to every packet every
+ * time i advertise a link update (up/down)*/
+static uint8_t sequence_number;
+
+/**@brief Our local link state database.*/
+static struct link_state_database lsdb;
+
+/**@brief Bit i set if node i+1 had the sink in the neighbour list of its last keep alive.*/
+static uint16_t sink_adjacent;
+
+#if !STUB_IMAGE
+/**@brief Number of keep alives in a row from neighbour X with a LSDB digest different from ours.*/
+static uint8_t digest_mismatches[TOTAL_NODES];
+
+/**@brief Neighbour we asked for its LSDB and are receiving it from. 0 if none.*/
+static uint8_t repair_from;
+
+/**@brief When expired the LSDB we asked for should have arrived, we can ask again.*/
+static struct timer repair_timer;
+
+/**@brief Bit j of entry i is set if link i+1->j+1 was in the LSDB we are receiving.*/
+static uint16_t repair_seen[TOTAL_NODES];
+
+/**@brief Newest sequence number per origin in the LSDB we are receiving.*/
+static uint8_t repair_seq[TOTAL_NODES];
+
+/**@brief Links we got of the LSDB we are receiving.*/
+static uint16_t repair_count;
+
+/**@brief Neighbour we are sending our LSDB to, a link at a time from the send process. 0 if none.*/
+static uint8_t dump_to;
+
+/**@brief Next link of our LSDB to look at for dump_to, as (src-1)*TOTAL_NODES + dst-1.*/
+static uint16_t dump_cursor;
+
+/**@brief Links of our LSDB sent to dump_to so far, the end marker carries the number.*/
+static uint16_t dump_count;
+#endif
+
+/**@brief Checkpoints of the LSDB in flash.*/
+static LsdbStore lsdb_store;
+
+/**@brief True if we restored the LSDB from flash after a reboot.
+ * Our own links are then validated lazily: links to neighbours we don't
+ * hear from in DOWN_PERIOD are taken down as usual.*/
+static bool lsdb_restored;
+
+static int tx_power;
+
+/**@brief Transmission power the radio is set to.*/
+static int8_t radio_tx_power = TX_POWER;
+
+/**@brief Frames handed to the MAC layer that it didn't report back on yet, all sent with radio_tx_power.*/
+static uint8_t frames_pending;
+
+/**@brief True if tx_ka_pkt waits for the frames with a reduced power, to go out with TX_POWER.*/
+static bool broadcast_waiting;
+
+/**@brief Offset between my local clock and the network time (clock ticks).*/
+static clock_time_t time_offset;
+
+/**@brief Hops between me and the sink along which i got the network time.*/
+static uint8_t sync_depth = TIMESYNC_UNSYNCED;
+
+/**@brief Neighbour i took over the network time from.*/
+static uint8_t sync_parent;
+
+/**@brief Definition in "lib/list.h"*/
+LIST(history_table);
+
+/**@brief Definition in "lib/memb.h"*/
+MEMB(history_mem, struct history_entry, RUNICAST_RX_HISTORY_ENTRIES);
+
+PROCESS(routing_process, "Routing process");
+PROCESS(send_process, "Send process");
+
+/**@brief Node ids of the sinks.*/
+static const uint8_t sink_ids[] = SINK_IDS;
+
+/**@brief True if id is one of the sinks.
+ * @param id Node id.*/
+static bool is_sink(uint8_t id){
+	uint8_t k;
+	for(k=0;k<sizeof(sink_ids);k++){
+		if(sink_ids[k] == id){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**@brief True if we are a sink. Constant in a role image, see NODE_ROLE.*/
+static bool am_sink(void){
+#if NODE_ROLE == NODE_ROLE_ANY
+	return is_sink(node_id);
+#else
+	return NODE_ROLE == NODE_ROLE_SINK;
+#endif
+}
+
+/**@brief True if we are a sensor mote. Constant in a role image, see NODE_ROLE.*/
+static bool am_sensor(void){
+#if NODE_ROLE == NODE_ROLE_ANY
+	return node_id % 2 == 0;
+#else
+	return NODE_ROLE == NODE_ROLE_SENSOR;
+#endif
+}
+
+/**@brief Current network time in clock ticks.
+ * On the sink this is just the local clock.*/
+static clock_time_t network_time(void){
+	return clock_time() + time_offset;
+}
+
+/**@brief Take over the network time advertised in a keep alive packet.
+ * We follow the neighbour closest to the sink. The parent we synced to is
+ * followed on every keep alive, to keep track of the clock drift.
+ * The radio delay of the keep alive (at most one channel check interval) is ignored.
+ * @param rx_time Network time of the sender.
+ * @param rx_depth Sync depth of the sender.
+ * @param from Node id of the sender.
+ */
+static void update_time_sync(uint32_t rx_time, uint8_t rx_depth, uint8_t from){
+	if((am_sink() && node_id == SINK_ID) || rx_depth == TIMESYNC_UNSYNCED){
+		return;
+	}
+	if(rx_depth + 1 < sync_depth || from == sync_parent){
+		time_offset = rx_time - clock_time();
+		sync_depth = rx_depth + 1;
+		sync_parent = from;
+		printf("Synced to %d (depth %d), network time: %lu\n", from, sync_depth, (unsigned long)network_time());
+	}
+}
+
+/**@brief Fill the time sync, digest, liveness and slot fields of the keep alive packet for transmission.*/
+static void fill_tx_ka_time(void){
+	tx_ka_pkt.network_time = network_time();
+	tx_ka_pkt.sync_depth = sync_depth;
+	tx_ka_pkt.lsdb_digest = lsdb.digest;
+	tx_ka_pkt.liveness = TrickleLiveness(&trickle)/CLOCK_SECOND + 1;
+	ScheduleAdvertise(&schedule, tx_ka_pkt.slots);
+}
+
+/**@brief We heard a packet from a neighbour, so it is alive.
+ * It is considered down if we don't hear from it again within the liveness
+ * of its last keep alive (plus one transmit frame, since keep alives wait for their slot),
+ * or within DOWN_PERIOD if we didn't get a keep alive from it yet.
+ * @param id Node id of the neighbour.*/
+static void heard_from(uint8_t id){
+	if(neighbour_liveness[id-1] > 0){
+		timer_set(&liveness_timer[id-1], neighbour_liveness[id-1]*CLOCK_SECOND + SLOT_FRAME_LENGTH*SLOT_DURATION);
+	}else{
+		timer_set(&liveness_timer[id-1], DOWN_PERIOD);
+	}
+	if(lsdb.ka_received[id-1] < 255){
+		lsdb.ka_received[id-1] += 1;
+	}
+}
+
+/**@brief Something changed around us (neighbour came or went, our links, the LSDB digest).
+ * Go back to fast keep alives. Called from callbacks, so the keep alive timer is
+ * set again by the routing process on the poll event.*/
+static void hello_inconsistent(void){
+	piggybacked = 0;///@warning The next keep alive goes out, with the news.
+	if(TrickleReset(&trickle)){
+		process_poll(&routing_process);
+	}
+}
+
+/**@brief True if id is a stub node, a sensor mote that only knows its own uplinks.
+ * @param id Node id.*/
+static bool is_stub(uint8_t id){
+#if STUB_NODE_MODE
+	return id % 2 == 0;
+#else
+	return false;
+#endif
+}
+
+/**@brief Cost of a link in the local LSDB, 0 if it isn't there.
+ * The image of a stub node only keeps its own links, see STUB_IMAGE.
+ * @param src Source of the link.
+ * @param dst Destination of the link.*/
+static uint16_t lsdb_cost(uint8_t src, uint8_t dst){
+#if STUB_IMAGE
+	return src == node_id ? lsdb.node_links_cost[0][dst-1] : 0;
+#else
+	return lsdb.node_links_cost[src-1][dst-1];
+#endif
+}
+
+/**@brief True if a neighbour list contains one of the sinks.
+ * @param neighbours Neighbour list, e.g. from a keep alive.*/
+static bool lists_sink(uint8_t neighbours[TOTAL_NODES]){
+	uint8_t k;
+	for(k=0;k<sizeof(sink_ids);k++){
+		if(neighbours[sink_ids[k]-1] == sink_ids[k]){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**@brief True if we and the owner of a neighbour list are both adjacent to the same sink.
+ * @param neighbours Neighbour list from a keep alive.*/
+static bool shares_sink(uint8_t neighbours[TOTAL_NODES]){
+	uint8_t k;
+	uint8_t s;
+	for(k=0;k<sizeof(sink_ids);k++){
+		s = sink_ids[k];
+		if((lsdb_cost(node_id, s) > 0 || lsdb.neighbours[s-1] > 0) && neighbours[s-1] == s){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**@brief Best parent of a sensor mote among its uplinks.
+ * The cheapest sink if we have a link to one, otherwise we prefer bridges that are adjacent to the sink,
+ * then the cheapest link and then the one with the highest battery left.
+ * @param exclude Node id not to pick, to get the second best parent. 0 for none.
+ * @return Node id of the parent, 0 if we have no uplink.*/
+static uint8_t best_parent(uint8_t exclude){
+	uint8_t i;
+	uint8_t parent = 0;
+	bool parent_sink_adjacent = false;
+	bool adjacent;
+
+	for(i=0;i<sizeof(sink_ids);i++){
+		if(sink_ids[i] != exclude && lsdb_cost(node_id, sink_ids[i]) > 0 &&
+				(parent == 0 || lsdb_cost(node_id, sink_ids[i]) < lsdb_cost(node_id, parent))){
+			parent = sink_ids[i];
+		}
+	}
+	if(parent != 0){
+		return parent;
+	}
+	for(i=0;i<TOTAL_NODES;i++){
+		if(lsdb_cost(node_id, i+1) == 0 || i+1 == exclude || is_sink(i+1)){
+			continue;
+		}
+		adjacent = (sink_adjacent & (1 << i)) != 0;
+		if(parent == 0 || (adjacent && !parent_sink_adjacent) ||
+				(adjacent == parent_sink_adjacent && lsdb_cost(node_id, i+1) < lsdb_cost(node_id, parent)) ||
+				(adjacent == parent_sink_adjacent && lsdb_cost(node_id, i+1) == lsdb_cost(node_id, parent) &&
+						neighbour_battery[i] > neighbour_battery[parent-1])){
+			parent = i+1;
+			parent_sink_adjacent = adjacent;
+		}
+	}
+	return parent;
+}
+
+/**@brief Hash of a link for the LSDB digest.
+ * @param src Source of the link.
+ * @param dst Destination of the link.*/
+static uint16_t link_digest(uint8_t src, uint8_t dst){
+	uint16_t x = (src-1)*TOTAL_NODES + dst;
+	x *= 0x9E37;
+	x ^= x >> 7;
+	x *= 0x2C1B;
+	x ^= x >> 9;
+	return x;
+}
+
+/**@brief Set the cost of a link in the local LSDB.
+ * Every write to node_links_cost goes through here, so the digest is updated incrementally.
+ * Only links not starting at a sensor mote are part of the digest, since these are the
+ * links every bridge and the sink should know about (see send_lsdb_to()). Cost changes are
+ * refreshed locally from keep alives, so only links coming and going change the digest.
+ * @param src Source of the link.
+ * @param dst Destination of the link.
+ * @param cost New cost, 0 removes the link.*/
+static void lsdb_set_cost(uint8_t src, uint8_t dst, uint16_t cost){
+#if STUB_IMAGE
+	if(src != node_id){
+		return;///@warning A stub node only keeps its own links.
+	}
+#endif
+	if((lsdb_cost(src, dst) > 0) != (cost > 0)){
+		if(src % 2 != 0){
+			lsdb.digest ^= link_digest(src, dst);
+		}
+		if(src == node_id || dst == node_id){
+			hello_inconsistent();
+		}
+	}
+#if STUB_IMAGE
+	lsdb.node_links_cost[0][dst-1] = cost;
+#else
+	lsdb.node_links_cost[src-1][dst-1] = cost;
+#endif
+	routes_dirty = true;
+}
+
+/**@brief Compute the digest of the whole LSDB, after it was restored from flash.*/
+static void lsdb_recompute_digest(void){
+	uint8_t i, j;
+	lsdb.digest = 0;
+	for(i=0;i<TOTAL_NODES;i++){
+		for(j=0;j<TOTAL_NODES;j++){
+			if((i+1) % 2 != 0 && lsdb_cost(i+1, j+1) > 0){
+				lsdb.digest ^= link_digest(i+1, j+1);
+			}
+		}
+	}
+}
+
+/**@brief Delay until our next transmit slot that is at least earliest ticks away.*/
+static clock_time_t next_tx_slot(clock_time_t earliest){
+	return ScheduleNextSlot(&schedule, network_time(), earliest);
+}
+
+/**@brief Transmission power of the packets to a node.
+ * @param id Node id of the receiver, 0 for a broadcast, which always goes out with TX_POWER.*/
+static int8_t link_tx_power(uint8_t id){
+	return id == 0 ? TX_POWER : LinkEstimatorTxPower(&estimator, id);
+}
+
+/**@brief True if a packet to id can be handed to the MAC layer now.
+ * The radio has one power for all frames, also for runicast retransmissions, so it is only
+ * changed once the MAC layer reported back on every frame it has. A waiting broadcast holds
+ * back the packets with a reduced power until it went out.
+ * @param id Node id of the receiver, 0 for a broadcast.*/
+static bool tx_power_free(uint8_t id){
+	int8_t power = link_tx_power(id);
+	if(broadcast_waiting && power != TX_POWER){
+		return false;
+	}
+	return frames_pending == 0 || power == radio_tx_power;
+}
+
+/**@brief Set the transmission power for a packet to id, checked with tx_power_free().
+ * It stays until release_tx_power() was called for every packet.
+ * @param id Node id of the receiver, 0 for a broadcast.*/
+static void claim_tx_power(uint8_t id){
+	int8_t power = link_tx_power(id);
+	if(power != radio_tx_power){
+		radio_tx_power = power;
+		NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_TXPOWER, power);
+	}
+	frames_pending++;
+}
+
+/**@brief The MAC layer reported back on a packet. Once it has none left the radio goes back to TX_POWER.*/
+static void release_tx_power(void){
+	if(frames_pending > 0){
+		frames_pending--;
+	}
+	if(frames_pending == 0 && radio_tx_power != TX_POWER){
+		radio_tx_power = TX_POWER;
+		NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_TXPOWER, TX_POWER);
+	}
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);///@warning Packets held back for the power can go now.
+}
+
+/**@brief Occupancy of our data queue in percent.*/
+static uint8_t queue_load(void){
+	return (uint16_t)BufferLength(&buffer, BUFFER_DATA)*100/(BUFFER_SIZE-1);
+}
+
+/**@brief True if neighbour id advertised a congested data queue.
+ * @param id Node id.*/
+static bool is_loaded(uint8_t id){
+	return neighbour_load[id-1] >= BACKPRESSURE_HIGH;
+}
+
+/**@brief Track whether our data queue is congested, with hysteresis.
+ * Neighbours have to hear about a change quickly, so it resets the keep alive interval.*/
+static void check_congestion(void){
+	uint8_t load = queue_load();
+	if(!congested && load >= BACKPRESSURE_HIGH){
+		printf(RED"Data queue congested (%d%%)!\n"RESET, load);
+		congested = true;
+		hello_inconsistent();
+	}else if(congested && load <= BACKPRESSURE_LOW){
+		printf("Data queue free again (%d%%)\n", load);
+		congested = false;
+		hello_inconsistent();
+	}
+}
+
+/**@brief Fill the piggybacked keep alive information of a LSA or unicast packet for transmission.
+ * @param ext Header extension of the packet.*/
+static void fill_frame_ext(struct frame_ext *ext){
+	ext->battery_value = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+	ext->liveness = TrickleLiveness(&trickle)/CLOCK_SECOND + 1;
+	ext->queue_load = queue_load();
+}
+
+/**@brief Take over the piggybacked keep alive information of a LSA or unicast packet.
+ * Call before heard_from(), which uses the liveness.
+ * @param id Node id of the sender.
+ * @param ext Header extension of the packet.*/
+static void frame_ext_received(uint8_t id, struct frame_ext *ext){
+	neighbour_liveness[id-1] = ext->liveness;
+	neighbour_battery[id-1] = ext->battery_value;
+	neighbour_load[id-1] = ext->queue_load;
+}
+
+/**@brief True if our keep alive can be left out, since every neighbour got a packet from us since the last one.
+ * Not more than KEEP_ALIVE_MAX_PIGGYBACKED times in a row.*/
+static bool hello_piggybacked(void){
+	uint8_t i;
+	bool any = false;
+	if(hellos_piggybacked >= KEEP_ALIVE_MAX_PIGGYBACKED){
+		return false;
+	}
+	for(i=0;i<TOTAL_NODES;i++){
+		if(lsdb.neighbours[i] != 0){
+			if((piggybacked & (1 << i)) == 0){
+				return false;
+			}
+			any = true;
+		}
+	}
+	if(any){
+		hellos_piggybacked++;
+	}
+	return any;
+}
+
+/**@brief Take a packet of a traffic class from the pool, to be built in place.
+ * @param class Traffic class, see buffer.h.
+ * @return The packet, NULL if it has to be dropped.*/
+static BufferEntry *alloc_entry(uint8_t class){
+	BufferEntry *entry = BufferAlloc(&buffer, class);
+	if(entry == NULL){
+		printf("Buffer of class %d is full, dropping packet!\n", class);
+	}
+	return entry;
+}
+
+/**@brief Put a packet in the queue of its traffic class, with a timer expiring in our next transmit slot (pre-backoff).
+ * @param entry Packet taken with alloc_entry() or resent, the timer is set here. It goes back to the pool if it is dropped.
+ * @return True if it was enqueued.*/
+static bool enqueue_entry(BufferEntry *entry){
+	timer_set(&entry->timer, next_tx_slot(0));
+	// Put packet and timer in queue
+	if(BufferIn(&buffer, entry) == BUFFER_FAIL){
+		printf("Buffer of class %d is full, dropping packet!\n", entry->class);
+		BufferFree(&buffer, entry);
+		return false;
+	}
+	//Inform send process a new packet was enqueued.
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);
+	if(entry->class == BUFFER_DATA){
+		check_congestion();
+	}
+	return true;
+}
+
+/**@brief Take the next neighbour a packet still has to be sent to.
+ * @param fanout Bit i set if node i+1 still gets the packet, the bit is cleared.
+ * @return Node id, 0 if there is none.*/
+static uint8_t next_fanout(uint16_t *fanout){
+	uint8_t i;
+	for(i=0;i<TOTAL_NODES;i++){
+		if(*fanout & (1 << i)){
+			*fanout &= ~(1 << i);
+			return i+1;
+		}
+	}
+	return 0;
+}
+
+/**@brief Neighbours a flooded LSA goes to, decided when it is enqueued.
+ * @param pkt LSA.
+ * @param forward If true we are forwarding a LSA generated by someone else, if false it is our own.
+ * @return Bit i set if node i+1 gets the LSA.*/
+static uint16_t lsa_fanout(const struct lsa *pkt, bool forward){
+	uint16_t fanout = 0;
+	uint8_t i;
+	for(i=0;i<TOTAL_NODES;i++){
+		if(lsdb_cost(node_id, i+1) == 0){
+			continue;///@warning Only to neighbours to which there is an outgoing link.
+		}
+		if(is_stub(i+1) && pkt->endpoint_addresses[0] != i+1 && pkt->endpoint_addresses[1] != i+1){
+			continue;///@warning Stub nodes only get LSAs about their own links.
+		}
+		if(forward == false){
+			//You only have outgoing links to a bridge or the sink, a sensor mote sends its own LSA to the other end of the link.
+			if(pkt->endpoint_addresses[0]%2 != 0 || pkt->endpoint_addresses[1] == i+1){
+				fanout |= 1 << i;
+			}
+		}else if(i+1 != pkt->endpoint_addresses[0] && i+1 != pkt->endpoint_addresses[1] && i+1 != sender_id){
+			// Controlled flooding, not back to the link src, the link dst or the node that sent it to us.
+			fanout |= 1 << i;
+		}
+	}
+	return fanout;
+}
+
+/**@brief Start a topology event of our own, the LSAs enqueued from now on are flooded for it.*/
+static void new_flood_event(void){
+	flood_events++;
+	flood_origin = node_id;
+	flood_id = flood_events;
+	printf("Topology event %d of %d\n", flood_id, flood_origin);
+}
+
+/**@brief Count a LSA we received that we already had, for the topology event it is flooded for.*/
+static void count_flood_duplicate(void){
+	if(flood_origin != 0){
+		FloodCostFind(&flood_cost, flood_origin, flood_id)->duplicates++;
+	}
+}
+
+/**@brief Count the retransmissions of the LSA runicast sent last, for the topology event it is flooded for.
+ * @param retransmissions Retransmissions runicast reported.*/
+static void count_flood_retransmissions(uint8_t retransmissions){
+	FloodCount *count;
+	if(flood_inflight_origin != 0 && retransmissions > 0){
+		count = FloodCostFind(&flood_cost, flood_inflight_origin, flood_inflight_id);
+		count->retx += retransmissions;
+	}
+	flood_inflight_origin = 0;
+}
+
+/**@brief Build a LSA in place in a packet of the pool and enqueue it.
+ * LSDB transfers are bulk traffic to the neighbour that asked, everything else is flooded as control traffic.
+ * @param cost Cost of the link.
+ * @param src Source of the link.
+ * @param dst Destination of the link.
+ * @param seq_nr Sequence number generated by src.
+ * @param forward If true we are forwarding a LSA generated by someone else, if false it is our own.
+ * @param reply_to Neighbour that asked for our LSDB, 0 to flood the LSA.
+ * @return The enqueued LSA, NULL if it was dropped.*/
+static BufferEntry *enqueue_lsa(uint16_t cost, uint8_t src, uint8_t dst, uint8_t seq_nr, bool forward, uint8_t reply_to){
+	BufferEntry *entry = alloc_entry(reply_to != 0 ? BUFFER_BULK : BUFFER_CONTROL);
+	if(entry == NULL){
+		return NULL;
+	}
+	fill_tx_lsa_pkt(&entry->packet.lsa, cost, src, dst, seq_nr, reply_to != 0);
+	entry->packet.lsa.event_origin = reply_to != 0 ? 0 : flood_origin;
+	entry->packet.lsa.event_id = reply_to != 0 ? 0 : flood_id;
+	entry->fanout = reply_to != 0 ? 1 << (reply_to-1) : lsa_fanout(&entry->packet.lsa, forward);
+	if(entry->fanout == 0){
+		printf("No neighbour to send the LSA to\n");
+		BufferFree(&buffer, entry);
+		return NULL;
+	}
+	print_tx_lsa_pkt_in_buf(&entry->packet.lsa);
+	return enqueue_entry(entry) ? entry : NULL;
+}
+
+/**@brief Pick our parent in collection tree mode.
+ * The neighbour with the cheapest path to the sink over it. The parent only changes for
+ * one that is at least TREE_PARENT_SWITCH cheaper, so it doesn't flip-flop.
+ * If our path cost changed, neighbours should know quickly.*/
+static void tree_select_parent(void){
+	uint8_t i;
+	uint8_t parent = 0;
+	uint32_t cost;
+	uint32_t parent_cost = DIJKSTRA_INFINITY;
+	uint32_t current_cost = DIJKSTRA_INFINITY;
+	uint16_t old_cost = tree_cost;
+
+	if(am_sink()){
+		tree_cost = 0;
+		return;
+	}
+	for(i=0;i<TOTAL_NODES;i++){
+		if(i+1 == node_id || lsdb.neighbours[i] == 0 || neighbour_path_cost[i] == DIJKSTRA_INFINITY){
+			continue;
+		}
+		cost = (uint32_t)neighbour_path_cost[i] + LinkEstimatorCost(&estimator, i+1);
+		if(i+1 == tree_parent){
+			current_cost = cost;
+		}
+		if(cost < parent_cost){
+			parent_cost = cost;
+			parent = i+1;
+		}
+	}
+	if(parent != tree_parent && current_cost < DIJKSTRA_INFINITY && parent_cost + TREE_PARENT_SWITCH > current_cost){
+		parent = tree_parent;
+		parent_cost = current_cost;
+	}
+	if(parent != tree_parent){
+		printf("New parent: %d (was %d), path cost %lu\n", parent, tree_parent, (unsigned long)parent_cost);
+		if(tree_parent != 0){
+			printf("\nLostLink: %d -> %d\n", node_id, tree_parent);//For the GUI.
+		}
+		if(parent != 0){
+			printf("\nNewLink: %d -> %d\n", node_id, parent);//For the GUI.
+		}
+		tree_parent = parent;
+	}
+	tree_cost = parent_cost < DIJKSTRA_INFINITY ? parent_cost : DIJKSTRA_INFINITY;
+	if(tree_cost > (uint32_t)old_cost + TREE_PARENT_SWITCH || (uint32_t)tree_cost + TREE_PARENT_SWITCH < old_cost){
+		hello_inconsistent();
+	}
+}
+
+/**@brief Route to a destination, the routing table is recomputed first if the LSDB changed.
+ * Stub nodes don't know the links of the bridges, so their route to the sink goes to
+ * their best parent, with the second best one as backup.
+ * @param dst Node id of the destination.*/
+static Route *route_to(uint8_t dst){
+	Route *route;
+	uint8_t i;
+	if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+		///@warning Only the route to the sink, over our parent. Neighbours closer to the sink than us are loop free backups.
+		route = &routing_table.routes[dst-1];
+		route->next_hop = is_sink(dst) ? tree_parent : 0;
+		route->backup = 0;
+		route->node_protecting = false;
+		route->candidates = route->next_hop != 0 ? 1 << (route->next_hop-1) : 0;
+		route->cost = is_sink(dst) ? tree_cost : DIJKSTRA_INFINITY;
+		for(i=0;i<TOTAL_NODES && route->next_hop != 0;i++){
+			if(i+1 != route->next_hop && lsdb.neighbours[i] != 0 && neighbour_path_cost[i] < tree_cost &&
+					(route->backup == 0 || neighbour_path_cost[i] < neighbour_path_cost[route->backup-1])){
+				route->backup = i+1;
+			}
+		}
+		return route;
+	}
+#if !STUB_IMAGE
+	if(routes_dirty){
+		RoutingTableCompute(&routing_table, lsdb.node_links_cost, node_id);
+		routes_dirty = false;
+	}
+#endif
+	route = &routing_table.routes[dst-1];
+	if(is_stub(node_id) && is_sink(dst)){
+		route->next_hop = best_parent(0);
+		route->backup = route->next_hop != 0 ? best_parent(route->next_hop) : 0;
+		route->node_protecting = false;
+		route->candidates = 0;
+		if(route->next_hop != 0){
+			route->candidates = 1 << (route->next_hop-1);
+			route->cost = lsdb_cost(node_id, route->next_hop);
+		}
+		if(route->next_hop != 0 && !is_sink(route->next_hop)){
+			///@warning Uplinks as good as the best parent, as far as we can tell.
+			for(i=0;i<TOTAL_NODES;i++){
+				if(!is_sink(i+1) && lsdb_cost(node_id, i+1) > 0 &&
+						((sink_adjacent >> i) & 1) == ((sink_adjacent >> (route->next_hop-1)) & 1) &&
+						(uint32_t)lsdb_cost(node_id, i+1)*100 <= (uint32_t)route->cost*(100 + MULTIPATH_STRETCH)){
+					route->candidates |= 1 << i;
+				}
+			}
+		}
+	}
+	return route;
+}
+
+/**@brief Route to the sink with the cheapest path.
+ * In collection tree mode the tree already leads to the nearest sink.*/
+static Route *route_to_sink(void){
+	Route *best = route_to(sink_ids[0]);
+	Route *route;
+	uint8_t k;
+	for(k=1;k<sizeof(sink_ids);k++){
+		route = route_to(sink_ids[k]);
+		if(route->next_hop != 0 && (best->next_hop == 0 || route->cost < best->cost)){
+			best = route;
+		}
+	}
+	return best;
+}
+
+/**@brief Path cost to the nearest sink we advertise in keep alives.
+ * Sensor motes don't forward data, so they advertise none.*/
+static uint16_t advertised_path_cost(void){
+	if(am_sink()){
+		return 0;
+	}
+	if(am_sensor()){
+		return DIJKSTRA_INFINITY;
+	}
+	return route_to_sink()->cost;
+}
+
+/**@brief Share of the data a next hop gets, from its battery value.
+ * @param id Node id of the next hop.*/
+static uint16_t battery_weight(uint8_t id){
+	if(neighbour_battery[id-1] <= MULTIPATH_BATTERY_FLOOR){
+		return 1;
+	}
+	return (neighbour_battery[id-1] - MULTIPATH_BATTERY_FLOOR)/MULTIPATH_BATTERY_STEP + 1;
+}
+
+/**@brief Pick one of the next hop candidates of a route, weighted by their battery.
+ * The pick depends on the source of the packet, so the packets of a sensor keep
+ * taking the same path (and stay in order) while the candidates don't change.
+ * Candidates that advertised a congested data queue are left out.
+ * @param route Route to the destination.
+ * @param source Node id of the sensor mote the packet comes from.
+ * @param from Node we got the packet from, it is not picked. 0 if it is our own.
+ * @return Node id of the next hop, route->next_hop if no candidate is left.*/
+static uint8_t pick_next_hop(Route *route, uint8_t source, uint8_t from){
+	uint8_t i;
+	uint32_t total = 0;
+	uint32_t point;
+	for(i=0;i<TOTAL_NODES;i++){
+		if((route->candidates & (1 << i)) && i+1 != from && tx_failures[i] == 0 && !is_loaded(i+1)){
+			total += battery_weight(i+1);
+		}
+	}
+	if(total == 0){
+		return route->next_hop;
+	}
+	point = ((uint16_t)(source * 0x9E37) >> 4) % total;
+	for(i=0;i<TOTAL_NODES;i++){
+		if((route->candidates & (1 << i)) && i+1 != from && tx_failures[i] == 0 && !is_loaded(i+1)){
+			if(point < battery_weight(i+1)){
+				return i+1;
+			}
+			point -= battery_weight(i+1);
+		}
+	}
+	return route->next_hop;
+}
+
+/**@brief Queue a data packet towards the nearest sink.
+ * It goes to one of the next hop candidates of our route (see pick_next_hop()), unless that is where
+ * the packet came from or the last transmission to it failed, then the backup next hop is used right away.
+ * Without a route it goes over our cheapest link, the TTL takes care of loops.
+ * @param pkt Data packet.
+ * @param from Node we got the packet from, 0 if it is our own.
+ * @param resend True if the packet is sent again after the MAC layer couldn't deliver it.*/
+static void send_data(BufferEntry *entry, uint8_t from, bool resend){
+	struct unicast_packet *pkt = &entry->packet.data;
+	Route *route = route_to_sink();
+	uint8_t next = pick_next_hop(route, pkt->path[0], from);
+	uint8_t i;
+	uint16_t min;
+
+	if(next == 0 || next == from || tx_failures[next-1] > 0){
+		if(route->backup != 0 && route->backup != from){
+			printf("Using backup next hop %d instead of %d\n", route->backup, next);
+			next = route->backup;
+		}else if(next == from){
+			next = 0;
+		}
+	}else if(is_loaded(next) && route->backup != 0 && route->backup != from && !is_loaded(route->backup)){
+		printf("Next hop %d is congested, using backup next hop %d\n", next, route->backup);
+		next = route->backup;
+	}
+	if(next == 0){
+		//I know this is not very efficient and does not really prevent infinite routing loops, BUT
+		//it is only supposed to work for a limited number of hops.
+		///Dont send from where you received.
+		printf("We have no route to the sink, sending over our cheapest link!\n");
+		min = 0xFFFF;
+		for(i=0;i<TOTAL_NODES;i++){
+			if(lsdb_cost(node_id, i+1) > 0 && lsdb_cost(node_id, i+1) < min && i+1 != from){
+				min = lsdb_cost(node_id, i+1);
+				next = i+1;
+			}
+		}
+	}
+	if(next == 0){
+		printf("No link to send the data packet over, dropping it!\n");
+		BufferFree(&buffer, entry);
+		return;
+	}
+	pkt->path_cost = ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE ? tree_cost : route->cost;
+	entry->fanout = 1 << (next-1);
+	entry->from = from;
+	entry->resend = resend;
+	enqueue_entry(entry);
+}
+
+/**@brief Take a burst of SAMPLING_OVERSAMPLE samples of an ADC channel and filter it.
+ * @param sampling Filter of the channel.
+ * @param channel ADC channel, like ZOUL_SENSORS_ADC3.
+ * @param name Name of the channel for the log, which the harness in sampling.c can read.
+ * @return Filtered raw value (12 bit).*/
+static uint16_t read_adc(Sampling *sampling, int channel, const char *name){
+	static uint16_t burst[SAMPLING_OVERSAMPLE];
+	uint8_t i;
+	uint16_t value;
+
+	printf("%s samples:", name);
+	for(i=0;i<SAMPLING_OVERSAMPLE;i++){
+		/*Data is in the 12 MSBs.*/
+		burst[i] = adc_zoul.value(channel) >> 4;
+		printf(" %d", burst[i]);
+	}
+	value = SamplingAdd(sampling, burst, SAMPLING_OVERSAMPLE);
+	printf("\n%s value [Filtered] = %d\n", name, value);
+	return value;
+}
+
+/**@brief Bytes of a unicast packet to send, the unused part of the batch is left out.
+ * @param pkt Unicast packet.*/
+static uint16_t unicast_packet_length(struct unicast_packet *pkt){
+	return offsetof(struct unicast_packet, batch) + pkt->batch_length;
+}
+
+/**@brief Send the readings in the batch as one data packet and start a new batch.*/
+static void send_batch(void){
+	BufferEntry *entry;
+	struct unicast_packet *pkt;
+
+	if(batch.count == 0){
+		return;
+	}
+	entry = alloc_entry(BUFFER_DATA);
+	if(entry != NULL){
+		// built in place in the pool, it is copied once, into packetbuf
+		pkt = &entry->packet.data;
+		memset(pkt, 0, offsetof(struct unicast_packet, batch));
+		pkt->data_packet = true;
+		pkt->data_type = node_id;
+		pkt->seq = data_seq++;
+		pkt->epoch = data_epoch;
+		pkt->data = batch.first;
+		pkt->timestamp = batch.first_time;
+		pkt->timestamp_valid = batch_timestamp_valid;
+		pkt->path[0] = node_id;
+		pkt->ttl = TTL;
+#if LATENCY_TRACE
+		pkt->created = sync_depth != TIMESYNC_UNSYNCED ? network_time() : 0;
+#endif
+		pkt->batch_count = batch.count;
+		pkt->batch_length = batch.length;
+		memcpy(pkt->batch, batch.bytes, batch.length);
+		printf("Data packet size: (%d) bytes, %d readings\n", unicast_packet_length(pkt), batch.count);
+		send_data(entry, 0, false);
+	}
+	SampleBatchInit(&batch);
+}
+
+/**@brief Add a reading to the batch, send the batch once it is full or old enough.
+ * @param value Converted sensor value.*/
+static void add_reading(uint16_t value){
+	uint16_t now = network_time()/CLOCK_SECOND;
+	bool synced = (sync_depth != TIMESYNC_UNSYNCED);
+
+	if(batch.count > 0 && synced != batch_timestamp_valid){
+		send_batch();///@warning Times with and without the network time don't mix.
+	}
+	batch_timestamp_valid = synced;
+	if(SampleBatchAdd(&batch, value, now) == SAMPLE_BATCH_FAIL){
+		send_batch();
+		SampleBatchAdd(&batch, value, now);
+	}
+	if(batch.count >= SAMPLE_BATCH_SIZE || (uint16_t)(now - batch.first_time) >= SAMPLE_BATCH_MAX_AGE/CLOCK_SECOND){
+		send_batch();
+	}
+}
+
+/**@brief Add the readings of a data packet that arrived at the sink to the summary of its sensor.
+ * With summary_raw they are also printed, one line each for the GUI.
+ * @param pkt Data packet.*/
+static void print_readings(struct unicast_packet *pkt){
+	uint16_t value = pkt->data;
+	uint16_t time = pkt->timestamp;
+	uint16_t delay;
+	uint32_t now = network_time()/CLOCK_SECOND;
+	Summary *summary = NULL;
+	uint8_t length = pkt->batch_length < SAMPLE_BATCH_BYTES ? pkt->batch_length : SAMPLE_BATCH_BYTES;
+	uint8_t offset = 0;
+	uint8_t i;
+
+	if(pkt->data_type % 2 == 0 && pkt->data_type > 0 && pkt->data_type/2 <= SINK_SENSORS){
+		summary = &summaries[pkt->data_type/2-1];
+	}
+	for(i=0;i<pkt->batch_count;i++){
+		if(i > 0 && SampleBatchNext(pkt->batch, length, &offset, &value, &time) == SAMPLE_BATCH_FAIL){
+			printf("Broken batch, got %d of %d readings!\n", i, pkt->batch_count);
+			break;
+		}
+		if(pkt->timestamp_valid){
+			///@warning The timestamp wraps around, the difference is still right for delays below ~9h.
+			delay = (int16_t)((uint16_t)now - time) < 0 ? 0 : (uint16_t)now - time;///@warning A sensor clock ahead of ours gives no delay.
+			if(summary_raw){
+				printf("\nDataType: %d Data: %d Time: %lu Delay: %u\n", pkt->data_type, value,
+						(unsigned long)(now - delay), delay);
+			}
+		}else{
+			delay = 0;///@warning Best guess, the reading is as old as the packet.
+			if(summary_raw){
+				printf("\nDataType: %d Data: %d\n", pkt->data_type, value);
+			}
+		}
+		if(summary != NULL){
+			SummaryAdd(summary, value, now - delay);
+		}
+	}
+}
+
+/**@brief Print the summaries of all sensors we got readings of, one line per window for the GUI.
+ * Time is the network time of the last reading, so the GUI can tell which sink saw the newest one.*/
+static void print_summaries(void){
+	uint32_t now = network_time()/CLOCK_SECOND;
+	SummaryStats stats;
+	uint8_t i, w;
+
+	for(i=0;i<SINK_SENSORS;i++){
+		if(!summaries[i].valid){
+			continue;
+		}
+		for(w=0;w<SUMMARY_WINDOW_COUNT;w++){
+			if(SummaryGet(&summaries[i], w, now, &stats) == SUMMARY_FAIL){
+				stats.count = 0;
+				stats.min = stats.max = stats.mean = summaries[i].last;
+			}
+			printf("\nSummary: %d Window: %lu Count: %u Min: %u Max: %u Mean: %u Last: %u Age: %lu Total: %lu Time: %lu Sink: %d\n",
+					2*(i+1), (unsigned long)SummaryWindow(w), stats.count, stats.min, stats.max, stats.mean,
+					summaries[i].last, (unsigned long)(now - summaries[i].last_time), (unsigned long)summaries[i].total,
+					(unsigned long)summaries[i].last_time, node_id);
+		}
+	}
+}
+
+#if LATENCY_TRACE
+/**@brief Add the time a data packet waited in our queue to its latency trace, at our position in its path.
+ * @param pkt Data packet.
+ * @param ticks Clock ticks it waited.*/
+static void add_dwell(struct unicast_packet *pkt, clock_time_t ticks){
+	uint8_t i;
+	uint32_t dwell;
+	for(i=TOTAL_NODES;i>0 && pkt->path[i-1] != node_id;i--);
+	if(i == 0){
+		return;
+	}
+	dwell = (uint32_t)pkt->dwell[i-1] + ticks;
+	pkt->dwell[i-1] = dwell < 0xFFFF ? dwell : 0xFFFF;
+}
+
+/**@brief Add the latency trace of a data packet that arrived at the sink to the distributions of its sensor.
+ * With summary_raw it is also printed.
+ * @param pkt Data packet.*/
+static void record_latency(struct unicast_packet *pkt){
+	LatencyStats *stats;
+	uint32_t queued = 0;
+	uint32_t end_to_end;
+	uint8_t i;
+
+	if(pkt->data_type % 2 != 0 || pkt->data_type == 0 || pkt->data_type/2 > SINK_SENSORS){
+		return;
+	}
+	stats = &latency[pkt->data_type/2-1];
+	for(i=0;i<TOTAL_NODES && pkt->path[i] != 0;i++){
+		queued += pkt->dwell[i];
+		LatencyAdd(&stats->hops[i < LATENCY_HOPS ? i : LATENCY_HOPS-1], (uint32_t)pkt->dwell[i]*1000/CLOCK_SECOND);
+	}
+	queued = queued*1000/CLOCK_SECOND;
+	LatencyAdd(&stats->queued, queued);
+	if(summary_raw){
+		printf("LatencyTrace: %d Dwell:", pkt->data_type);
+		for(i=0;i<TOTAL_NODES && pkt->path[i] != 0;i++){
+			printf(" %lu", (unsigned long)pkt->dwell[i]*1000/CLOCK_SECOND);
+		}
+		printf("\n");
+	}
+	if(pkt->created == 0 || network_time() < pkt->created){
+		return;///@warning The sensor had no network time, or it was corrected since.
+	}
+	end_to_end = (uint32_t)(network_time() - pkt->created)*1000/CLOCK_SECOND;
+	LatencyAdd(&stats->end_to_end, end_to_end);
+	LatencyAdd(&stats->air, end_to_end > queued ? end_to_end - queued : 0);
+	if(summary_raw){
+		printf("LatencyTrace: %d E2E: %lu\n", pkt->data_type, (unsigned long)end_to_end);
+	}
+}
+
+/**@brief Print one latency distribution of a sensor, for the GUI.
+ * @param type Data type of the sensor.
+ * @param stage What the latencies are of.
+ * @param histogram Latencies.*/
+static void print_latency_histogram(uint8_t type, const char *stage, const LatencyHistogram *histogram){
+	printf("Latency: %d Stage: %s Count: %u P50: %lu P95: %lu P99: %lu\n", type, stage, histogram->total,
+			(unsigned long)LatencyPercentile(histogram, 50), (unsigned long)LatencyPercentile(histogram, 95),
+			(unsigned long)LatencyPercentile(histogram, 99));
+}
+
+/**@brief Print the latency distributions (ms) of all sensors we got data packets of.*/
+static void print_latency(void){
+	char stage[8];
+	uint8_t i, h;
 
-/** @brief Link State Adverisment packet for reception.*/
-static struct lsa rx_lsa_pkt;
+	for(i=0;i<SINK_SENSORS;i++){
+		if(latency[i].queued.total == 0){
+			continue;
+		}
+		print_latency_histogram(2*(i+1), "e2e", &latency[i].end_to_end);
+		print_latency_histogram(2*(i+1), "queue", &latency[i].queued);
+		print_latency_histogram(2*(i+1), "air", &latency[i].air);
+		for(h=0;h<LATENCY_HOPS;h++){
+			if(latency[i].hops[h].total > 0){
+				sprintf(stage, "hop%d", h+1);
+				print_latency_histogram(2*(i+1), stage, &latency[i].hops[h]);
+			}
+		}
+	}
+}
+#endif
+
+/**@brief Count a data packet that arrived at the sink for the delivery of its sensor.
+ * The packets of other nodes are only checked for copies, a resent flood report is counted once.
+ * @param pkt Data packet.
+ * @return DELIVERY_FAIL if we got it before.*/
+static uint8_t record_delivery(struct unicast_packet *pkt){
+	uint8_t length;
+
+	if(pkt->data_type % 2 != 0){
+		if(pkt->data_type/2 >= SINK_REPORTERS){
+			return DELIVERY_SUCCESS;
+		}
+		return DeliverySeenAdd(&reporters_seen[pkt->data_type/2], pkt->epoch, pkt->seq);
+	}
+	if(pkt->data_type == 0 || pkt->data_type/2 > SINK_SENSORS){
+		return DELIVERY_SUCCESS;
+	}
+	for(length=0;length<TOTAL_NODES && pkt->path[length] != 0;length++);
+	return DeliveryAdd(&delivery[pkt->data_type/2-1], pkt->epoch, pkt->seq, pkt->path, length);
+}
 
-/** @brief Link State Advertisment packet for transimission.*/
-static struct lsa tx_lsa_pkt;
+/**@brief Print the delivery of the data packets of all sensors we got data packets of, and of the paths they took, for the GUI.
+ * Every sink only counts the packets that reached it, the host merges the sinks.*/
+static void print_delivery(void){
+	DeliveryPath *path;
+	uint16_t ratio;
+	uint8_t i, p, h;
 
-/**@brief Unicast packet for transmissions.*/
-static struct unicast_packet tx_uni_pkt;
+	for(i=0;i<SINK_SENSORS;i++){
+		if(!delivery[i].valid){
+			continue;
+		}
+		ratio = DeliveryRatio(&delivery[i]);
+		printf("Delivery: %d Expected: %lu Received: %lu Lost: %lu Duplicates: %lu Reordered: %lu Restarts: %u PDR: %u.%u Sink: %d\n",
+				2*(i+1), (unsigned long)delivery[i].expected, (unsigned long)delivery[i].received,
+				(unsigned long)DeliveryLost(&delivery[i]), (unsigned long)delivery[i].duplicates,
+				(unsigned long)delivery[i].reordered, delivery[i].restarts, ratio/10, ratio%10, node_id);
+		for(p=0;p<DELIVERY_PATHS;p++){
+			path = &delivery[i].paths[p];
+			if(path->length == 0){
+				continue;
+			}
+			printf("DeliveryPath: %d Path: ", 2*(i+1));
+			for(h=0;h<path->length;h++){
+				printf("%d-", path->hops[h]);
+			}
+			printf("%d Received: %u Duplicates: %u Reordered: %u Sink: %d\n", node_id, path->received, path->duplicates,
+					path->reordered, node_id);
+		}
+	}
+}
 
-/**@brief Unicast packet for reception.*/
-static struct unicast_packet rx_uni_pkt;
+/**@brief Add the flooding cost a node reported for a topology event to its totals and print them, for the GUI.
+ * @param from Node that reported.
+ * @param report Its counts.*/
+static void record_flood_report(uint8_t from, const struct flood_report *report){
+	FloodCount *total = FloodCostFind(&flood_totals, report->origin, report->id);
+
+	FloodCostAdd(total, report->tx, report->retx, report->duplicates, report->received);
+	printf("FloodReport: %d Event: %d/%d Tx: %u Retx: %u Duplicates: %u Received: %u\n", from, report->origin, report->id,
+			report->tx, report->retx, report->duplicates, report->received);
+	printf("FloodCost: %d/%d Nodes: %u Tx: %u Retx: %u Duplicates: %u Received: %u\n", total->origin, total->id,
+			total->nodes, total->tx, total->retx, total->duplicates, total->received);
+}
 
-//***** MISC VARIABLES*****
-/**@brief If forward True we have received an LCA and do reliable forwarding to neighbours.
- * If forward False we generated the packet and reliably flood it to our neighbours.*/
-static bool forward;
+/**@brief Print the totals of the flooding cost of the topology events reported to us.*/
+static void print_floods(void){
+	FloodCount *total;
+	uint8_t i;
 
-/**@brief Buffer to store packets until TX.*/
-static Buffer buffer;
+	for(i=0;i<FLOOD_EVENTS;i++){
+		total = &flood_totals.events[i];
+		if(total->origin != 0){
+			printf("FloodCost: %d/%d Nodes: %u Tx: %u Retx: %u Duplicates: %u Received: %u\n", total->origin, total->id,
+					total->nodes, total->tx, total->retx, total->duplicates, total->received);
+		}
+	}
+}
 
-/**@brief Node ID.*/
-static uint8_t node_id;
+/**@brief Report the flooding cost of a topology event that is over to the sink, in a data packet.
+ * The sink adds its own to the totals. One event per call.*/
+static void report_floods(void){
+	FloodCount *count = FloodCostQuiet(&flood_cost, FLOOD_REPORT_DELAY);
+	struct flood_report report;
+	BufferEntry *entry;
+	struct unicast_packet *pkt;
 
-/**@brief ID of sender.*/
-static uint8_t sender_id;
+	if(count == NULL){
+		return;
+	}
+	count->reported = true;
+	report.origin = count->origin;
+	report.id = count->id;
+	report.tx = count->tx;
+	report.retx = count->retx;
+	report.duplicates = count->duplicates;
+	report.received = count->received;
+	if(am_sink()){
+		record_flood_report(node_id, &report);
+		return;
+	}
+	entry = alloc_entry(BUFFER_DATA);
+	if(entry == NULL){
+		return;
+	}
+	pkt = &entry->packet.data;
+	memset(pkt, 0, offsetof(struct unicast_packet, batch));
+	pkt->data_packet = true;
+	pkt->data_type = node_id;
+	pkt->seq = data_seq++;
+	pkt->epoch = data_epoch;
+	pkt->flood_report = true;
+	pkt->path[0] = node_id;
+	pkt->ttl = TTL;
+	pkt->batch_length = sizeof(report);
+	memcpy(pkt->batch, &report, sizeof(report));
+	printf("Reporting flooding cost of event %d/%d to the sink\n", report.origin, report.id);
+	send_data(entry, 0, false);
+}
 
-/**@brief Global destination variable used by various functions
- * to construct a link address and send a (r)/unicast.*/
-static linkaddr_t dst_t;
+/**@brief Change the interval of the summaries sent to the host.
+ * @param seconds New interval, 0 stops them.*/
+static void set_summary_interval(uint16_t seconds){
+	summary_interval = (clock_time_t)seconds*CLOCK_SECOND;
+	if(summary_interval > 0){
+		etimer_set(&summary_timer, summary_interval);
+	}else{
+		etimer_stop(&summary_timer);
+	}
+	printf("Summary interval: %u s\n", seconds);
+}
 
-/**@brief Destination of sensor data.*/
-static linkaddr_t sensor_dest;
+/**@brief Broadcast tx_ka_pkt with TX_POWER. If frames with a reduced power are still out,
+ * broadcast_waiting is set instead and the keep alive timer tries again.*/
+static void broadcast_keep_alive(void){
+	if(!tx_power_free(0)){
+		printf("Frames with a reduced power are still out, broadcasting in our next slot\n");
+		broadcast_waiting = true;
+		return;
+	}
+	broadcast_waiting = false;
+	fill_tx_ka_time();
+	tx_ka_pkt.path_cost = advertised_path_cost();
+	tx_ka_pkt.queue_load = queue_load();
+	memcpy(tx_ka_pkt.neighbours, lsdb.neighbours, sizeof(lsdb.neighbours));
+	packetbuf_copyfrom(&tx_ka_pkt, sizeof(tx_ka_pkt));
+	printf("BROADCAST PACKET SIZE: %d (bytes), liveness: %d s\n", sizeof(tx_ka_pkt), tx_ka_pkt.liveness);
+	claim_tx_power(0);
+	broadcast_send(&broadcast);
+	NETSTACK_CONF_RADIO.get_value(RADIO_PARAM_TXPOWER, &tx_power);
+	printf("Broadcast message sent with power: %d\r\n", tx_power);
+}
 
-/**@brief List of received ages when first going live.*/
-static uint8_t rx_ages[TOTAL_NODES];
+/**@brief Transmit a data packet taken from the buffer. It is kept until the MAC layer reports back.
+ * @param entry Data packet, removed from its queue.
+ * @param id Next hop.*/
+static void transmit_data(BufferEntry *entry, uint8_t id){
+	last_data = entry;
+	last_data_to = id;
+	unicast_to = id;
+	printf("Data packet send to: %d\n", id);
+#if LATENCY_TRACE
+	add_dwell(&entry->packet.data, clock_time() - entry->timer.start);///@warning Enqueued at timer.start, a resend adds the wait of its queue.
+#endif
+	dst_t.u8[0] = 0;
+	dst_t.u8[1] = id;
+	fill_frame_ext(&entry->packet.data.ext);
+	packetbuf_copyfrom(&entry->packet.data, unicast_packet_length(&entry->packet.data));
+	leds_on(TX_PKT_COLOR);
+	claim_tx_power(id);
+	unicast_send(&unicast, &dst_t);
+	leds_off(TX_PKT_COLOR);
+}
 
-/**@brief Used when calculating the next hop for data packets.*/
-static uint8_t next_hop[TOTAL_NODES];
+/**@brief Runicast a LSA taken from the buffer to one neighbour.
+ * @param entry LSA, at the head of its queue.
+ * @param id Neighbour.*/
+static void transmit_lsa(BufferEntry *entry, uint8_t id){
+	dst_t.u8[0] = 0;
+	dst_t.u8[1] = id;
+	printf(RED"SENDING LSA TO: %d\n"RESET, id);
+	flood_inflight_origin = entry->packet.lsa.event_origin;
+	flood_inflight_id = entry->packet.lsa.event_id;
+	if(flood_inflight_origin != 0){
+		FloodCostFind(&flood_cost, flood_inflight_origin, flood_inflight_id)->tx++;
+	}
+	fill_frame_ext(&entry->packet.lsa.ext);
+	packetbuf_copyfrom(&entry->packet.lsa, sizeof(entry->packet.lsa));
+	leds_on(TX_PKT_COLOR);
+	claim_tx_power(id);
+	runicast_send(&runicast, &dst_t, RUNICAST_MAX_RETRANSMISSIONS);
+	leds_off(TX_PKT_COLOR);
+}
 
-/**@brief My sequence number, that i attach to every packet every
- * time i advertise a link update (up/down)*/
-static uint8_t sequence_number;
+/**@brief Unicast a LSDB age or request taken from the buffer.
+ * @param entry Unicast packet, removed from its queue.
+ * @param id Neighbour.*/
+static void transmit_unicast(BufferEntry *entry, uint8_t id){
+	unicast_to = id;
+	dst_t.u8[0] = 0;
+	dst_t.u8[1] = id;
+	fill_frame_ext(&entry->packet.data.ext);
+	packetbuf_copyfrom(&entry->packet.data, unicast_packet_length(&entry->packet.data));
+	leds_on(TX_PKT_COLOR);
+	claim_tx_power(id);
+	unicast_send(&unicast, &dst_t);
+	leds_off(TX_PKT_COLOR);
+}
 
-/**@brief Our local link state database.*/
-static struct link_state_database lsdb;
+/**@brief True if a packet at the head of its queue can be handed to the MAC layer now.
+ * LSAs go out with runicast, one at a time. The other packets are unicasts, also one at a time,
+ * so every report of the MAC layer is about the one sent last. A data packet also waits until
+ * the one before it was delivered or sent again. All wait for a transmission power, see tx_power_free().
+ * @param entry Packet at the head of its queue.*/
+static bool can_transmit(BufferEntry *entry){
+	uint16_t fanout = entry->fanout;
+	if(!tx_power_free(next_fanout(&fanout))){
+		return false;
+	}
+	if(entry->class != BUFFER_DATA && !entry->unicast){
+		return !runicast_is_transmitting(&runicast);
+	}
+	return unicast_to == 0 && (entry->class != BUFFER_DATA || last_data == NULL);
+}
 
-static int tx_power;
+/**@brief Traffic classes whose next packet can be handed to the MAC layer now, see can_transmit().*/
+static uint8_t transmit_mask(void){
+	BufferEntry *head;
+	uint8_t mask = 0;
+	uint8_t class;
+	for(class=0;class<BUFFER_CLASSES;class++){
+		head = BufferHead(&buffer, class);
+		if(head != NULL && can_transmit(head)){
+			mask |= BUFFER_CLASS_MASK(class);
+		}
+	}
+	return mask;
+}
 
-/**@brief Definition in "lib/list.h"*/
-LIST(history_table);
+/**@brief Interval until the next sensor reading.
+ * Doubles for every reading our next hop is congested and halves for every reading it isn't.*/
+static clock_time_t sensor_read_interval(void){
+	uint8_t next = route_to_sink()->next_hop;
+	if(next != 0 && is_loaded(next)){
+		if(sensor_backoff < BACKPRESSURE_MAX_BACKOFF){
+			sensor_backoff++;
+		}
+		printf("Next hop %d is congested, reading every %d s\n", next, (int)((SENSOR_READ_INTERVAL << sensor_backoff)/CLOCK_SECOND));
+	}else if(sensor_backoff > 0){
+		sensor_backoff--;
+	}
+	return (clock_time_t)SENSOR_READ_INTERVAL << sensor_backoff;
+}
 
-/**@brief Definition in "lib/memb.h"*/
-MEMB(history_mem, struct history_entry, RUNICAST_RX_HISTORY_ENTRIES);
+/**@brief Delay of the first sensor reading after the network went live or the LSDB was pulled.
+ * Spreads the sensor motes evenly over SENSOR_READ_INTERVAL by node id, so they don't all report at once.*/
+static clock_time_t sensor_read_stagger(void){
+	return (clock_time_t)SENSOR_READ_INTERVAL/TOTAL_NODES*node_id;
+}
 
-PROCESS(routing_process, "Routing process");
-PROCESS(send_process, "Send process");
+/**@brief Print the length of the transmit queues and the packets they dropped.*/
+static void print_queues(void){
+	uint8_t class;
+	for(class=0;class<BUFFER_CLASSES;class++){
+		printf("Queue %d: %d packets, %d taken from the pool, %d dropped\n", class, BufferLength(&buffer, class), buffer.taken[class], buffer.dropped[class]);
+	}
+}
 
-/**@brief Put a LSA packet in the buffer with a random timer (pre-backoff).
- * @param tx_pkt Packet to enqueue
- * @forward Used later with send_runicast_to_neighbours(). Definition above.
- */
-static void enqueue_packet(struct lsa tx_pkt, bool forward, bool reply_to_send_lsdb_req, linkaddr_t dst){
-	uint8_t return_code;
-	struct timer pre_backoff_timer;
-	printf("enqueue_packet() called!\n");
+/**@brief Print our routing table.*/
+static void print_routing_table(void){
+	uint8_t i;
+	Route *route;
+	for(i=0;i<TOTAL_NODES;i++){
+		route = route_to(i+1);
+		if(route->next_hop != 0){
+			printf("To %d: next hop %d, backup %d%s, candidates 0x%04x, cost %d\n", i+1, route->next_hop, route->backup,
+					route->node_protecting ? " (node protecting)" : "", route->candidates, route->cost);
+		}
+	}
+}
 
-	timer_set(&pre_backoff_timer, CLOCK_SECOND*(node_id+random_rand()%(TOTAL_NODES*2)));
-	// Put packet and timer in queue
-	return_code = BufferIn(&buffer, tx_pkt, pre_backoff_timer, forward, reply_to_send_lsdb_req, dst);
-	if(return_code == BUFFER_FAIL){
-		printf("Buffer is full!");
-	}else{
-		//Inform send process a new packet was enqueued.
-		process_post(&send_process, PROCESS_EVENT_MSG, 0);
+/**@brief Queue a unicast that asks for or announces a LSDB, as control traffic.
+ * @param dst Neighbour to send it to.
+ * @param age Age of our LSDB, 0 if we don't announce it.
+ * @param send_lsdb If true dst is asked to send us its LSDB.*/
+static void enqueue_unicast(uint8_t dst, uint16_t age, bool send_lsdb){
+	BufferEntry *entry = alloc_entry(BUFFER_CONTROL);
+	if(entry == NULL){
+		return;
 	}
+	memset(&entry->packet.data, 0, sizeof(entry->packet.data));
+	entry->packet.data.data_packet = false;
+	entry->packet.data.lsdb_age = age;
+	entry->packet.data.send_lsdb = send_lsdb;
+	entry->unicast = true;
+	entry->fanout = 1 << (dst-1);
+	enqueue_entry(entry);
 }
 
 /**@brief Send my LSDB age to dest.
@@ -145,117 +1534,159 @@ static void enqueue_packet(struct lsa tx_pkt, bool forward, bool reply_to_send_l
  */
 static void send_lsdb_age(uint8_t dst){
 	printf("send_lsdb_age() called!\n");
-	if(lsdb.age > 0){///@warning Only reply if we have an age bigger than 0.
+	if(STUB_IMAGE){
+		printf("Stub node, no LSDB to give to: %d\n", dst);
+	}else if(lsdb.age > 0){///@warning Only reply if we have an age bigger than 0.
 		printf("SEND LSDB AGE TO: %d\n", dst);
-		tx_uni_pkt.data_packet = false;
-		tx_uni_pkt.lsdb_age = lsdb.age;
-		tx_uni_pkt.send_lsdb = false;
-		packetbuf_copyfrom(&tx_uni_pkt, sizeof(tx_uni_pkt));
-		dst_t.u8[0] = 0;
-		dst_t.u8[1] = dst;
-		leds_on(TX_PKT_COLOR);
-		unicast_send(&unicast, &dst_t);
-		leds_off(TX_PKT_COLOR);
+		enqueue_unicast(dst, lsdb.age, false);
 	}else{
 		printf("NOT SENDING AGE %d TO: %d\n", lsdb.age, dst);
 	}
 }
 
+#if !STUB_IMAGE
+/**@brief Ask dst to send us its LSDB.
+ * The links come in as LSAs with reply_to_send_lsdb_req set, followed by an
+ * end marker (link 0->0), see receive_lsdb_link().
+ * @param dst Node to get the LSDB from.*/
+static void send_lsdb_request(uint8_t dst){
+	printf("GET LSDB FROM: %d\n", dst);
+	repair_from = dst;
+	timer_set(&repair_timer, LSDB_REPAIR_TIMEOUT);
+	memset(repair_seen, 0, sizeof(repair_seen));
+	memset(repair_seq, 0, sizeof(repair_seq));
+	repair_count = 0;
+	enqueue_unicast(dst, 0, true);
+}
+
+/**@brief Take over a link of the LSDB we asked a neighbour for.
+ * Links are taken over if they are new to us or at least as new as ours.
+ * When the end marker arrives, links we have but the neighbour doesn't are removed,
+ * if the neighbour knows a sequence number of their origin at least as new as ours.
+ * A link lost on the way would look like one the neighbour doesn't have, so nothing is
+ * removed unless we got as many links as the end marker says were sent.
+ * Nothing of this is flooded, it only repairs our own copy.
+ * @param pkt The received LSA.
+ * @param from Node id of the sender.*/
+static void receive_lsdb_link(struct lsa *pkt, uint8_t from){
+	uint8_t src = pkt->endpoint_addresses[0];
+	uint8_t dst = pkt->endpoint_addresses[1];
+	uint8_t i, j;
+
+	if(src == 0 && dst == 0){///@warning End of the LSDB.
+		if(from != repair_from){
+			return;
+		}
+		repair_from = 0;
+		if(repair_count != pkt->link_cost){
+			printf("LSDB from %d incomplete, got %d of %d links, not removing any\n", from, repair_count, pkt->link_cost);
+			return;
+		}
+		for(i=0;i<TOTAL_NODES;i++){
+			if((i+1) % 2 == 0 || i+1 == node_id || repair_seq[i] == 0 || repair_seq[i] < lsdb.sequence_numbers[i]){
+				continue;
+			}
+			for(j=0;j<TOTAL_NODES;j++){
+				if(lsdb_cost(i+1, j+1) > 0 && !(repair_seen[i] & (1 << j))){
+					printf("Repair: %d doesn't know link %d->%d, removing it\n", from, i+1, j+1);
+					printf("\nLostLink: %d -> %d\n", i+1, j+1);//For the GUI.
+					lsdb_set_cost(i+1, j+1, 0);
+				}
+			}
+		}
+		printf("LSDB from %d received, digest now: %u\n", from, lsdb.digest);
+		print_link_state_database(&lsdb, node_id);
+		return;
+	}
+
+	if(src == 0 || dst == 0 || src > TOTAL_NODES || dst > TOTAL_NODES){
+		return;
+	}
+	if(from == repair_from){
+		repair_count++;
+		timer_restart(&repair_timer);///@warning The timeout is for the next link, a big LSDB takes a while.
+		repair_seen[src-1] |= 1 << (dst-1);
+		if(pkt->seq_nr > repair_seq[src-1]){
+			repair_seq[src-1] = pkt->seq_nr;
+		}
+	}
+	if(src == node_id){
+		return;///@warning Nobody knows our own links better than we do.
+	}
+	if(lsdb_cost(src, dst) == 0 || pkt->seq_nr >= lsdb.sequence_numbers[src-1] || pkt->seq_nr <= RESET_SQN_NO){
+		if(lsdb_cost(src, dst) == 0){
+			printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
+		}
+		lsdb_set_cost(src, dst, pkt->link_cost);
+		if(pkt->seq_nr > lsdb.sequence_numbers[src-1]){
+			lsdb.sequence_numbers[src-1] = pkt->seq_nr;
+		}
+	}
+}
+
 /**
- * @brief Send LSDB to destination
+ * @brief Start sending our LSDB to a neighbour that asked for it.
  * Our LSDB is (should be) symmetric so we only need to send
  * the upper half without the diagonal and only for the links
  * where the weight is non-zero.
- * @param dest Destinaiton to send LSDB.
+ * The links go out one at a time from the send process, see continue_lsdb_dump().
+ * One neighbour at a time, another one asking meanwhile asks again after LSDB_REPAIR_TIMEOUT.
+ * @param dst Destinaiton to send LSDB.
  */
 static void send_lsdb_to(uint8_t dst){
-	int i,j;
 	printf("send_lsdb_to() called!\n");
-
-	for(i=0;i<TOTAL_NODES;i++){
-		for(j=0;j<TOTAL_NODES;j++){
-			if(lsdb.node_links_cost[i][j] > 0){ ///@warning Only if non-zero.
-				if((i+1) % 2 != 0){
-				///@warning If src is not a Sensor mote.
-					fill_tx_lsa_pkt(&tx_lsa_pkt, lsdb.node_links_cost[i][j], i+1, j+1, sequence_number, true);
-					printf("SEND LSDB LINK TO: %d\n", dst);
-					dst_t.u8[0] = 0;
-					dst_t.u8[1] = dst;
-					print_tx_lsa_pkt_in_buf(&tx_lsa_pkt);
-					enqueue_packet(tx_lsa_pkt, false, true, dst_t);
-				}
-			}
-		}
+	if(is_stub(dst)){
+		printf("Not sending LSDB to stub node %d\n", dst);
+		return;
+	}
+	if(dump_to != 0 && dump_to != dst){
+		printf("Still sending our LSDB to %d, not to %d\n", dump_to, dst);
+		return;
 	}
+	dump_to = dst;
+	dump_cursor = 0;
+	dump_count = 0;
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);
 }
 
 /**
- * @brief Sends a unicast packets.
- * When called this function assumes that the packet to be sent is
- * already in the buffer.
- * @param forward If true we are forwarding a packet generated from someone
- * else, if false we are runicasting our own generated packet.
- * */
-static void send_runicast_to_neighbours(struct lsa tx_lsa_pkt, bool forward){
-	int i;
-	printf("send_runicast_to_neighbours(forward=%s) called!\n", forward ? "true":"false");
-	for(i=0;i<TOTAL_NODES;i++){
-		if(forward == false){
-			// Send the packet we generated to:
-			if(lsdb.node_links_cost[node_id-1][i]>0){
-				//To your outgoing links.
-				//You only have outgoing links to a bridge or the sink.
-				if(tx_lsa_pkt.endpoint_addresses[0]%2==0){
-					if(tx_lsa_pkt.endpoint_addresses[1] == i+1){
-						dst_t.u8[0] = 0;
-						dst_t.u8[1] = i+1;//lsdb.neighbours[i];
-						printf(RED"SENDING LSA TO: %d\n"RESET, i+1);//lsdb.neighbours[i]);
-						packetbuf_copyfrom(&tx_lsa_pkt, sizeof(tx_lsa_pkt));
-						print_tx_lsa_pkt_in_buf(&tx_lsa_pkt);
-						leds_on(TX_PKT_COLOR);
-						runicast_send(&runicast, &dst_t, RUNICAST_MAX_RETRANSMISSIONS);
-						leds_off(TX_PKT_COLOR);
-					}
-				}else{
-					dst_t.u8[0] = 0;
-					dst_t.u8[1] = i+1;//lsdb.neighbours[i];
-					printf(RED"SENDING LSA TO: %d\n"RESET, i+1);//lsdb.neighbours[i]);
-					packetbuf_copyfrom(&tx_lsa_pkt, sizeof(tx_lsa_pkt));
-					print_tx_lsa_pkt_in_buf(&tx_lsa_pkt);
-					leds_on(TX_PKT_COLOR);
-					runicast_send(&runicast, &dst_t, RUNICAST_MAX_RETRANSMISSIONS);
-					leds_off(TX_PKT_COLOR);
-				}
-			}
-		}else{
-			// Controlled flooding
-			// Forward to all our neighbours execpt:
-			if(i+1 != tx_lsa_pkt.endpoint_addresses[0]){///@warning Link src.
-				if(i+1 != tx_lsa_pkt.endpoint_addresses[1]){///@warning Link dst.
-					if(i+1 != sender_id){///@warning Node id of the sender who send as the runicast packet.
-						//TODO sender_id might be overwritten
-						if(lsdb.node_links_cost[node_id-1][i] > 0){///@warning Only to neighbours to which there is an outgoing link.
-							dst_t.u8[0] = 0;
-							dst_t.u8[1] = i+1;//lsdb.neighbours[i];
-							printf(RED"FORWARDING LSA TO: %d\n"RESET, i+1);//lsdb.neighbours[i]);
-							packetbuf_copyfrom(&tx_lsa_pkt, sizeof(tx_lsa_pkt));
-							print_tx_lsa_pkt_in_buf(&tx_lsa_pkt);
-							leds_on(TX_PKT_COLOR);
-							runicast_send(&runicast, &dst_t, RUNICAST_MAX_RETRANSMISSIONS);
-							leds_off(TX_PKT_COLOR);
-						}
-					}
-				}
+ * @brief Enqueue the next link of the LSDB we are sending, once the one before went out.
+ * A single link is queued at a time, so a LSDB of any size fits the bulk queue and the pool.
+ * The end marker (link 0->0) carries the number of links sent as its cost, so the
+ * receiver can tell whether it got them all before removing links it didn't get.
+ * Called from the send process.
+ */
+static void continue_lsdb_dump(void){
+	uint8_t i, j;
+	if(dump_to == 0 || BufferLength(&buffer, BUFFER_BULK) > 0){
+		return;
+	}
+	while(dump_cursor < TOTAL_NODES*TOTAL_NODES){
+		i = dump_cursor / TOTAL_NODES;
+		j = dump_cursor % TOTAL_NODES;
+		if((i+1) % 2 != 0 && lsdb_cost(i+1, j+1) > 0){///@warning Only if non-zero and src is not a sensor mote.
+			///@warning Attach the sequence number of the origin, so the receiver can tell old from new.
+			if(enqueue_lsa(lsdb_cost(i+1, j+1), i+1, j+1,
+					i+1 == node_id ? sequence_number : lsdb.sequence_numbers[i], false, dump_to) != NULL){
+				dump_cursor++;
+				dump_count++;
 			}
+			return;///@warning Tried again on the next call if it was dropped.
 		}
+		dump_cursor++;
+	}
+	// End marker, lets the receiver remove links we don't have.
+	if(enqueue_lsa(dump_count, 0, 0, 0, false, dump_to) != NULL){
+		printf("LSDB sent to %d, %d links\n", dump_to, dump_count);
+		dump_to = 0;
 	}
 }
+#endif
 
 /**
  * @brief Removes link bidirectionally from the local link state database
  * by setting the weight to 0.
- * Calls the fill_tx_lsa_pkt() function to fill the packet buffer.
- * Calls the send_runicast_to_neighbours() function to forward the link down
+ * Calls the enqueue_lsa() function to forward the link down
  * packet to our neighbours.
  * @param src Source of the link.
  * @param dst Destination of the link (the node that is considered down).
@@ -265,8 +1696,8 @@ static void remove_link_from_lsdb(uint8_t src, uint8_t dst, uint8_t seq_nr){
 	printf("remove_link_from_lsdb() with seq_nr %d called!\n", seq_nr);
 	if(seq_nr > lsdb.sequence_numbers[src-1] || seq_nr <= RESET_SQN_NO){///@warning RX SEQ NR higher than that of our record. Take over value.
 		printf(RED"SEQ NR higher, %d >= %d OR SEQ _NR %d <= 10\n"RESET, seq_nr, lsdb.sequence_numbers[src-1], seq_nr);
-		if(lsdb.node_links_cost[src-1][dst-1]>0){
-			lsdb.node_links_cost[src-1][dst-1] = 0;
+		if(lsdb_cost(src, dst)>0){
+			lsdb_set_cost(src, dst, 0);
 			lsdb.age += 1;
 			printf("\nLostLink: %d -> %d\n", src, dst);//For the GUI.
 			if(src == node_id){
@@ -275,12 +1706,11 @@ static void remove_link_from_lsdb(uint8_t src, uint8_t dst, uint8_t seq_nr){
 			}else{
 				forward = true;
 			}
-			fill_tx_lsa_pkt(&tx_lsa_pkt, 0, src, dst, seq_nr, false);
-			enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+			enqueue_lsa(0, src, dst, seq_nr, forward, 0);
 		}
 
-		if(lsdb.node_links_cost[dst-1][src-1]>0){
-			lsdb.node_links_cost[dst-1][src-1] = 0;
+		if(lsdb_cost(dst, src)>0){
+			lsdb_set_cost(dst, src, 0);
 			lsdb.age += 1;
 			printf("\nLostLink: %d -> %d\n", dst, src);//For the GUI.
 			if(src == node_id){
@@ -289,8 +1719,7 @@ static void remove_link_from_lsdb(uint8_t src, uint8_t dst, uint8_t seq_nr){
 			}else{
 				forward = true;
 			}
-			fill_tx_lsa_pkt(&tx_lsa_pkt, 0, dst, src, seq_nr, false);
-			enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+			enqueue_lsa(0, dst, src, seq_nr, forward, 0);
 		}
 
 		// Update old sequence number
@@ -299,20 +1728,18 @@ static void remove_link_from_lsdb(uint8_t src, uint8_t dst, uint8_t seq_nr){
 	}else if(seq_nr < lsdb.sequence_numbers[src-1]){///@warning RX SEQ NR lower than our record. Update what will the forwarded.
 		// We don't change our LSDB as we have the newest update.
 		forward = false;
-		fill_tx_lsa_pkt(&tx_lsa_pkt, lsdb.node_links_cost[src-1][dst-1], src, dst, lsdb.sequence_numbers[src-1], false);
-		enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+		enqueue_lsa(lsdb_cost(src, dst), src, dst, lsdb.sequence_numbers[src-1], forward, 0);
 	}else{
 		printf("IGNORING LSA with the sequence number %d from source %d, we already got that!\n", seq_nr, src);
+		count_flood_duplicate();
 	}
-	print_link_state_database(&lsdb);
+	print_link_state_database(&lsdb, node_id);
 }
 
 /**
  * @brief Add a directional link to the local link state database.\n
- * Calls the fill_tx_lsa_pkt() function passing a packet depending
- * on the sequence number.\n
- * Calls the send_runicast_to_neighbours() function to forward the link up
- * packet to our neighbours.
+ * Calls the enqueue_lsa() function passing a packet depending
+ * on the sequence number, to forward the link up packet to our neighbours.
  * @param src Source of the link.
  * @param dst Destination of the link.
  * @param cost Cost of the link.
@@ -320,11 +1747,12 @@ static void remove_link_from_lsdb(uint8_t src, uint8_t dst, uint8_t seq_nr){
  * */
 static void add_link_to_lsdb(uint8_t src, uint8_t dst, uint16_t cost, uint8_t seq_nr){
 	printf("add_link_to_lsdb()\n");
-	if(lsdb.node_links_cost[src-1][dst-1] >0){///@warning Link is in DB. Chech sequence numbers.
+	if(lsdb_cost(src, dst) >0){///@warning Link is in DB. Chech sequence numbers.
 		printf(RED"Link %d->%d is in DB, checking seq numbers!\n"RESET, src, dst);
 		if(seq_nr > lsdb.sequence_numbers[src-1] || seq_nr <= RESET_SQN_NO){///@warning RX SEQ NR higher than that of our record. Take over value.
 			printf(RED"SEQ NR higher, %d >= %d OR SEQ _NR %d <= RESET_SQN_NO\n"RESET, seq_nr, lsdb.sequence_numbers[src-1], seq_nr);
-			lsdb.node_links_cost[src-1][dst-1] = cost;
+			forward = (src != node_id);///@warning A cost update of someone else's link.
+			lsdb_set_cost(src, dst, cost);
 			printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
 			lsdb.age += 1;
 			lsdb.sequence_numbers[src-1] = seq_nr;
@@ -337,42 +1765,39 @@ static void add_link_to_lsdb(uint8_t src, uint8_t dst, uint16_t cost, uint8_t se
 			}else{
 				forward = true;
 			}*/
-			fill_tx_lsa_pkt(&tx_lsa_pkt, cost, src, dst, seq_nr, false);
-			enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+			enqueue_lsa(cost, src, dst, seq_nr, forward, 0);
 		}else if(seq_nr < lsdb.sequence_numbers[src-1]){///@warning RX SEQ NR lower than that of our record. Update what will be forwarded.
 			printf(RED"SEQ NR lower, %d < %d\n"RESET, seq_nr, lsdb.sequence_numbers[src-1]);
 			forward = false;
-			fill_tx_lsa_pkt(&tx_lsa_pkt, lsdb.node_links_cost[src-1][dst-1], src, dst, lsdb.sequence_numbers[src-1], false);
-			enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+			enqueue_lsa(lsdb_cost(src, dst), src, dst, lsdb.sequence_numbers[src-1], forward, 0);
 		}else{///@warning RX SEQ NR is the same. Don't do anything.
 			printf("IGNORING LSA with the sequence number %d from source %d, we already got that!\n", seq_nr, src);
+			count_flood_duplicate();
 		}
 
-	}else if(lsdb.node_links_cost[src-1][dst-1] == 0){///@warnign Link not in DB, add it.
+	}else if(lsdb_cost(src, dst) == 0){///@warnign Link not in DB, add it.
 		if(src == node_id){
 			// We generated the packet
 			forward = false;
-			if(src == SINK_ID){///@warning If src node 1 we dont do anything
+			if(is_sink(src)){///@warning If src is a sink we dont do anything
 				printf("\n");
 
-			}else if(dst == SINK_ID){
+			}else if(is_sink(dst)){
 				printf(RED"Link %d->%d (%d) not in DB, adding\n"RESET, src, dst, cost);
 				printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
 				sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
-				lsdb.node_links_cost[src-1][dst-1] =  cost;//vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+				lsdb_set_cost(src, dst, cost);//vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
 				lsdb.age += 1;
-				fill_tx_lsa_pkt(&tx_lsa_pkt, cost, src, dst, seq_nr, false);
-				enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+				enqueue_lsa(cost, src, dst, seq_nr, forward, 0);
 
 			}else{///@warning If not src/dst 1.
 				if(src % 2 != 0 && dst % 2 != 0){///@warning SRC and DST are bridges => DUPLEX Link.
 					printf(RED"Link %d->%d (%d) not in DB, adding\n"RESET, src, dst, cost);
 					printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
 					sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
-					lsdb.node_links_cost[src-1][dst-1] = cost;
+					lsdb_set_cost(src, dst, cost);
 					lsdb.age += 1;
-					fill_tx_lsa_pkt(&tx_lsa_pkt, cost, src, dst, seq_nr, false);
-					enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+					enqueue_lsa(cost, src, dst, seq_nr, forward, 0);
 
 				}else if(src % 2 != 0 && dst % 2 == 0){///@warning SRC Bridge and DST Sensor => Directed link from B->S.
 					printf("\n");
@@ -380,25 +1805,107 @@ static void add_link_to_lsdb(uint8_t src, uint8_t dst, uint16_t cost, uint8_t se
 					printf(RED"Link %d->%d (%d) not in DB, adding\n"RESET, src, dst, cost);
 					printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
 					sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
-					lsdb.node_links_cost[src-1][dst-1] = cost;
+					lsdb_set_cost(src, dst, cost);
 					lsdb.age += 1;
-					fill_tx_lsa_pkt(&tx_lsa_pkt, cost, src, dst, seq_nr, false);
-					enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+					enqueue_lsa(cost, src, dst, seq_nr, forward, 0);
 				}
 			}
 		}else{
 			// Someone forwarded the packet to us.
 			printf(RED"Link %d->%d (%d) not in DB, adding\n"RESET, src, dst, cost);
 			printf("\nNewLink: %d -> %d\n", src, dst);//For the GUI
-			lsdb.node_links_cost[src-1][dst-1] = cost;
+			lsdb_set_cost(src, dst, cost);
 			lsdb.age += 1;
 			lsdb.sequence_numbers[src-1] = seq_nr;
-			fill_tx_lsa_pkt(&tx_lsa_pkt, cost, src, dst, seq_nr, false);
 			forward = true;
-			enqueue_packet(tx_lsa_pkt, forward, false, dst_t);
+			enqueue_lsa(cost, src, dst, seq_nr, forward, 0);
 		}
 	}
-	print_link_state_database(&lsdb);
+	print_link_state_database(&lsdb, node_id);
+}
+
+/**@brief Advertise the new cost of our link to dst, if it changed by more than LINK_COST_HYSTERESIS percent.
+ * @param dst Destination of the link.
+ * @param cost New cost of the link.*/
+static void update_link_cost(uint8_t dst, uint16_t cost){
+	uint16_t old = lsdb_cost(node_id, dst);
+	uint16_t diff = cost > old ? cost - old : old - cost;
+
+	if((uint32_t)diff*100 <= (uint32_t)old*LINK_COST_HYSTERESIS){
+		return;
+	}
+	printf("Cost of link %d->%d changed: %d -> %d\n", node_id, dst, old, cost);
+	new_flood_event();
+	sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
+	lsdb_set_cost(node_id, dst, cost);
+	lsdb.age += 1;
+	forward = false;
+	enqueue_lsa(cost, node_id, dst, sequence_number, forward, 0);
+}
+
+/**@brief True if id is in our neighbour list or we have a link with it.
+ * @param id Node id.*/
+static bool is_neighbour(uint8_t id){
+	return lsdb.neighbours[id-1] != 0 || lsdb_cost(node_id, id) > 0 || lsdb_cost(id, node_id) > 0;
+}
+
+/**@brief A neighbour is considered down.
+ * Our links with it are taken down and advertised right away, and it is forgotten
+ * until we hear a keep alive from it again.
+ * @param id Node id of the neighbour.*/
+static void neighbour_down(uint8_t id){
+	uint8_t i;
+	if(id == sync_parent && sync_depth != 0){
+		///@warning Lost the node we took the network time from. Keep the offset, but sync to the next best.
+		printf("Lost time sync parent %d!\n", sync_parent);
+		sync_depth = TIMESYNC_UNSYNCED;
+	}
+	if(lsdb_cost(node_id, id) > 0 || lsdb_cost(id, node_id)>0){
+		//Link was previously up -> Link is now considered down.
+		printf(RED"I have a link down!\n"RESET);
+		sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
+		new_flood_event();
+		remove_link_from_lsdb(node_id, id, sequence_number);
+		FlapDampingFlap(&damping, id);
+	}
+	lsdb.neighbours[id-1] = 0;
+	lsdb.ka_received[id-1] = 0;
+	neighbour_liveness[id-1] = 0;
+	tx_failures[id-1] = 0;
+#if !STUB_IMAGE
+	if(id == dump_to){
+		dump_to = 0;///@warning It asks again when it is back.
+	}
+#endif
+	neighbour_load[id-1] = 0;
+	neighbour_path_cost[id-1] = DIJKSTRA_INFINITY;
+	LinkEstimatorReset(&estimator, id);
+	if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+		tree_select_parent();
+	}
+	hello_inconsistent();
+	// Rebuild the two hop neighbourhood of the schedule from the keep alives to come.
+	ScheduleClearNeighbourhood(&schedule);
+	for(i=0;i<TOTAL_NODES;i++){
+		ScheduleAddNeighbour(&schedule, lsdb.neighbours[i], SCHEDULE_UNKNOWN);
+	}
+}
+
+/**@brief A transmission to a neighbour failed.
+ * After LINK_SUSPECT_LIMIT failures in a row the neighbour is suspected to be down,
+ * we don't wait for its keep alives to time out.
+ * @param id Node id of the neighbour.
+ * @param weight LINK_SUSPECT_LIMIT for a runicast that ran out of retransmissions, 1 for a unicast.*/
+static void link_failed(uint8_t id, uint8_t weight){
+	if(id == 0 || id > TOTAL_NODES || id == node_id || !is_neighbour(id)){
+		return;
+	}
+	tx_failures[id-1] += weight;
+	printf("Transmission to %d failed (%d/%d)\n", id, tx_failures[id-1], LINK_SUSPECT_LIMIT);
+	if(tx_failures[id-1] >= LINK_SUSPECT_LIMIT){
+		printf(RED"Link to %d suspected down!\n"RESET, id);
+		neighbour_down(id);
+	}
 }
 
 /**@brief Callback function when we receive a broadcast.
@@ -407,12 +1914,15 @@ static void add_link_to_lsdb(uint8_t src, uint8_t dst, uint16_t cost, uint8_t se
  * 2) Keep Alive (Hello) packet.*/
 static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *from){
 	int i;
+	bool consistent;
 	int16_t rssi;
+	uint8_t slot;
 	leds_on(RX_PKT_COLOR);
 	rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
+	LinkEstimatorRssi(&estimator, from->u8[1], rssi);
 	printf("Broadcast message received from %d | ", from->u8[1]);
-	printf("RSSI: %d\n", rssi);
-	if(rssi >= IGNORE_RSSI_BELOW){
+	printf("RSSI: %d (average %d)\n", rssi, LinkEstimatorGetRssi(&estimator, from->u8[1]));
+	if(LinkEstimatorUsable(&estimator, from->u8[1])){
 		packetbuf_copyto(&rx_ka_pkt);
 		printf("Packet size %d(bytes):\n", packetbuf_datalen());
 		printf("Node ID: %d\n", from->u8[1]);
@@ -424,19 +1934,41 @@ static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *from){
 			}
 		}
 		printf("\n");
+		update_time_sync(rx_ka_pkt.network_time, rx_ka_pkt.sync_depth, from->u8[1]);
+		if(lists_sink(rx_ka_pkt.neighbours)){
+			sink_adjacent |= 1 << (from->u8[1]-1);
+		}else{
+			sink_adjacent &= ~(1 << (from->u8[1]-1));
+		}
+		// The sender and its neighbours are within two hops, with the slots they moved to.
+		slot = schedule.slot;
+		ScheduleAddNeighbour(&schedule, from->u8[1], rx_ka_pkt.slots[from->u8[1]-1]);
+		for(i=0;i<TOTAL_NODES;i++){
+			if(rx_ka_pkt.neighbours[i] != 0){
+				ScheduleAddNeighbour(&schedule, rx_ka_pkt.neighbours[i], rx_ka_pkt.slots[i]);
+			}
+		}
+		if(schedule.slot != slot){
+			hello_inconsistent();///@warning Our neighbours have to compare with our new slot.
+		}
 	}else{
-		printf("Ignoring broadcast packet with RSSI:%d\n", rssi);
+		printf("Ignoring broadcast packet, average RSSI:%d\n", LinkEstimatorGetRssi(&estimator, from->u8[1]));
 		leds_off(RX_PKT_COLOR);
 		return;
 	}
 
+	neighbour_liveness[from->u8[1]-1] = rx_ka_pkt.liveness;
+	neighbour_battery[from->u8[1]-1] = rx_ka_pkt.battery_value;
+	neighbour_load[from->u8[1]-1] = rx_ka_pkt.queue_load;
+
 	if(rx_ka_pkt.get_lsdb_req == true){///@warning Sender asking for LSDB age.
 		lsdb.neighbours[from->u8[1]-1] = from->u8[1];///@warning Add LSDB Age asker to neighbours.
-		lsdb.ka_received[from->u8[1]-1] += 1;
+		heard_from(from->u8[1]);
+		hello_inconsistent();///@warning A node just went live, let it find us quickly.
 
 		//TODO MAYBE IF WE ALREADY SEE OUR NODE ID IN THE RX NEIGBOUR LIST ADD A LINK.
 		//if(node_id != 1 && node_id % 2 != 0){///@warning The sink (node 1) or Sensor nodes don't respond to this request.
-		if(node_id % 2 != 0){
+		if(!am_sensor()){
 			dst_t.u8[0] = 0;
 			dst_t.u8[1] = from->u8[1];
 			send_lsdb_age(from->u8[1]);
@@ -444,28 +1976,61 @@ static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *from){
 			printf("Not responding to LSDB age request since we have a node id: %d\n", node_id);
 		}
 	}else if(rx_ka_pkt.get_lsdb_req == false){///@warning Normal keep alive message.
+		consistent = (rx_ka_pkt.neighbours[node_id-1] == node_id);
 		if(lsdb.neighbours[from->u8[1]-1] != from->u8[1]){///@warning Neighbour not in list.
 			lsdb.neighbours[from->u8[1]-1] = from->u8[1];
-
+			consistent = false;
+			hello_inconsistent();
+		}
+		if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+			///@warning No links and no LSAs, only the path cost of the sender.
+			neighbour_path_cost[from->u8[1]-1] = rx_ka_pkt.path_cost;
+			tree_select_parent();
+			if(consistent){
+				TrickleConsistent(&trickle);
+			}
+			heard_from(from->u8[1]);
+			leds_off(RX_PKT_COLOR);
+			return;
 		}
+#if !STUB_IMAGE
+		if(!am_sensor() && from->u8[1] % 2 != 0){///@warning Bridges and the sink should agree on the transit links.
+			if(rx_ka_pkt.lsdb_digest != lsdb.digest){
+				consistent = false;
+				hello_inconsistent();
+				digest_mismatches[from->u8[1]-1] += 1;
+				printf("LSDB digest of %d: %u, mine: %u (%d in a row)\n", from->u8[1], rx_ka_pkt.lsdb_digest, lsdb.digest, digest_mismatches[from->u8[1]-1]);
+				if(digest_mismatches[from->u8[1]-1] >= LSDB_DIGEST_MISMATCH_LIMIT && (repair_from == 0 || timer_expired(&repair_timer))){
+					digest_mismatches[from->u8[1]-1] = 0;
+					send_lsdb_request(from->u8[1]);
+				}
+			}else{
+				digest_mismatches[from->u8[1]-1] = 0;
+			}
+		}
+#endif
 		if(node_id == rx_ka_pkt.neighbours[node_id-1]){///@warning My node id is in the received neighbours list.
-			if(lsdb.ka_received[from->u8[1]-1] >= 0 && (lsdb.node_links_cost[node_id-1][from->u8[1]-1] == 0)){
+			if(lsdb.ka_received[from->u8[1]-1] >= 0 && (lsdb_cost(node_id, from->u8[1]) == 0)){
 				///@warning If we go from 0 keep alive packets received to 1 and the link was previously down, then the link is completely new. Since in the case of a link between sensor and bridge we only add one directed link.
 
-				if( (lsdb.node_links_cost[node_id-1][SINK_ID-1]>0||lsdb.neighbours[SINK_ID-1]>0) && rx_ka_pkt.neighbours[SINK_ID-1] == SINK_ID){///@warning If SRC and DST both have node 1 as neighbour, no need for link between us.
-					printf("No need for link between: %d->%d, both can reach 1 with one hop!\n", node_id, from->u8[1]);
+				if(shares_sink(rx_ka_pkt.neighbours)){///@warning If SRC and DST both have the same sink as neighbour, no need for link between us.
+					printf("No need for link between: %d->%d, both can reach a sink with one hop!\n", node_id, from->u8[1]);
+				}else if(FlapDampingSuppressed(&damping, from->u8[1])){
+					printf("Not adding link %d->%d, it is flapping\n", node_id, from->u8[1]);
 				}else{
-					add_link_to_lsdb(node_id, from->u8[1], rx_ka_pkt.battery_value, sequence_number);
+					new_flood_event();
+					add_link_to_lsdb(node_id, from->u8[1], LinkEstimatorCost(&estimator, from->u8[1]), sequence_number);
 				}
-			}else if(lsdb.ka_received[from->u8[1]-1] > 0 && lsdb.node_links_cost[node_id-1][from->u8[1]-1] > 0){
-				///@warning We already have that link. Update to latest cost received from him.
-				lsdb.node_links_cost[node_id-1][from->u8[1]-1] = rx_ka_pkt.battery_value;
-			}else if(lsdb.ka_received[from->u8[1]-1] > 0 && lsdb.node_links_cost[from->u8[1]-1][node_id-1] > 0){
-				///@warning Update link cost of them to send to me. Just for looks.
-				lsdb.node_links_cost[from->u8[1]-1][node_id-1] = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+			}else if(lsdb.ka_received[from->u8[1]-1] > 0 && lsdb_cost(node_id, from->u8[1]) > 0){
+				///@warning We already have that link. Advertise the latest estimate if it changed enough.
+				update_link_cost(from->u8[1], LinkEstimatorCost(&estimator, from->u8[1]));
 			}
+			///@warning The cost of their link to us is theirs to advertise.
 		}
-		lsdb.ka_received[from->u8[1]-1] += 1;
+		if(consistent){
+			TrickleConsistent(&trickle);
+		}
+		heard_from(from->u8[1]);
 	}
 	leds_off(RX_PKT_COLOR);
 }
@@ -479,7 +2044,8 @@ static void runicast_recv(struct runicast_conn *c, const linkaddr_t *from, uint8
 	packetbuf_copyto(&rx_lsa_pkt);
 
 	// Since we heard from the sender
-	lsdb.ka_received[from->u8[1]-1] += 1;
+	frame_ext_received(from->u8[1], &rx_lsa_pkt.ext);
+	heard_from(from->u8[1]);
 
 		/*Sender History.*/
 	struct history_entry *e = NULL;
@@ -502,6 +2068,9 @@ static void runicast_recv(struct runicast_conn *c, const linkaddr_t *from, uint8
 		/*Detect duplicate callbacks.*/
 		if(e->seq == seqno){
 			printf("(DUPLICATE) Runicast message received from %d, seqno %d\n", from->u8[1], seqno);
+			if(rx_lsa_pkt.event_origin != 0){
+				FloodCostFind(&flood_cost, rx_lsa_pkt.event_origin, rx_lsa_pkt.event_id)->duplicates++;
+			}
 			return;
 		}
 		/*Update existing history entry.*/
@@ -516,12 +2085,22 @@ static void runicast_recv(struct runicast_conn *c, const linkaddr_t *from, uint8
 	printf("Link cost: %d\n", rx_lsa_pkt.link_cost);
 	printf("Link: %d->%d\n", rx_lsa_pkt.endpoint_addresses[0], rx_lsa_pkt.endpoint_addresses[1]);
 	printf("Seq nr: %d\n", rx_lsa_pkt.seq_nr);
-	printf("Reply to send LSDB req: %s\n", tx_lsa_pkt.reply_to_send_lsdb_req ? "true":"false");
+	printf("Reply to send LSDB req: %s\n", rx_lsa_pkt.reply_to_send_lsdb_req ? "true":"false");
 
 	if(rx_lsa_pkt.reply_to_send_lsdb_req == true){///@warning We got a reply to our send LSDB request.
-		lsdb.node_links_cost[rx_lsa_pkt.endpoint_addresses[0]-1][rx_lsa_pkt.endpoint_addresses[1]-1] = rx_lsa_pkt.link_cost;
-		print_link_state_database(&lsdb);
+#if !STUB_IMAGE
+		receive_lsdb_link(&rx_lsa_pkt, sender_id);
+#endif
+	}else if(is_stub(node_id) && rx_lsa_pkt.endpoint_addresses[0] != node_id && (STUB_IMAGE || rx_lsa_pkt.endpoint_addresses[1] != node_id)){
+		///@warning The image of a stub node doesn't keep the links to it either, they are the neighbour's to advertise.
+		printf("Stub node, ignoring LSA about link %d->%d\n", rx_lsa_pkt.endpoint_addresses[0], rx_lsa_pkt.endpoint_addresses[1]);
 	}else if(rx_lsa_pkt.reply_to_send_lsdb_req == false){///@warning Normal LSA.
+		///@warning The LSAs we flood in turn are for the same topology event.
+		flood_origin = rx_lsa_pkt.event_origin;
+		flood_id = rx_lsa_pkt.event_id;
+		if(flood_origin != 0){
+			FloodCostFind(&flood_cost, flood_origin, flood_id)->received++;
+		}
 		if(rx_lsa_pkt.link_cost > 0){
 			add_link_to_lsdb(
 					rx_lsa_pkt.endpoint_addresses[0],
@@ -548,12 +2127,15 @@ static void runicast_recv(struct runicast_conn *c, const linkaddr_t *from, uint8
 static void unicast_recv(struct unicast_conn *c, const linkaddr_t *from){
 
 	uint8_t i;
-	uint16_t max;
+	BufferEntry *entry;
+	struct flood_report flood_report;
 	leds_on(RX_PKT_COLOR);
+	packetbuf_copyto(&rx_uni_pkt);
+
 	// Since we heard from the sender
-	lsdb.ka_received[from->u8[1]-1] += 1;
+	frame_ext_received(from->u8[1], &rx_uni_pkt.ext);
+	heard_from(from->u8[1]);
 
-	packetbuf_copyto(&rx_uni_pkt);
 	printf("Unicast message received from %d | ", from->u8[1]);
 	printf("Packet size: %d(bytes)\n", packetbuf_datalen());
 	printf("Node id: %d\n", from->u8[1]);
@@ -568,15 +2150,33 @@ static void unicast_recv(struct unicast_conn *c, const linkaddr_t *from){
 			lsdb.neighbours[from->u8[1]-1] = from->u8[1];///@warning Add LSDB Age sender to neighbour list.
 
 		}else if(rx_uni_pkt.send_lsdb == true){///@warning Got LSDB send request.
+#if STUB_IMAGE
+			printf("Stub node, no LSDB to send to: %d\n", from->u8[1]);
+#else
 	  send_lsdb_to(from->u8[1]);
+#endif
 		}
 	}else if(rx_uni_pkt.data_packet == true){///@warning Data packet.
 		printf("Got data packet from: %d!\n", from->u8[1]);
-		if(node_id == SINK_ID){///@warning Package arrived at sink!
+		if(am_sink()){///@warning Package arrived at a sink!
 			printf(RED"Package arrived at destination: %d!\n"RESET, node_id);
-			printf("\nDataType: %d Data: %d\n", rx_uni_pkt.data_type, rx_uni_pkt.data);
-			printf("PacketPath:");
-			for(i=0;i<TOTAL_NODES;i++){
+			if(record_delivery(&rx_uni_pkt) == DELIVERY_FAIL){
+				printf("Data packet %u of %d received before, ignoring its readings\n", rx_uni_pkt.seq, rx_uni_pkt.data_type);
+			}else if(rx_uni_pkt.flood_report){
+				if(rx_uni_pkt.batch_length >= sizeof(flood_report)){
+					memcpy(&flood_report, rx_uni_pkt.batch, sizeof(flood_report));///@warning The batch isn't aligned.
+					record_flood_report(rx_uni_pkt.data_type, &flood_report);
+				}
+			}else{
+				print_readings(&rx_uni_pkt);
+#if LATENCY_TRACE
+				record_latency(&rx_uni_pkt);
+#endif
+			}
+			for(i=0;i<TOTAL_NODES && summary_raw;i++){
+				if(i == 0){
+					printf("PacketPath:");
+				}
 				if(rx_uni_pkt.path[i] != 0){
 					printf(" %d ->", rx_uni_pkt.path[i]);
 				}else{
@@ -586,8 +2186,8 @@ static void unicast_recv(struct unicast_conn *c, const linkaddr_t *from){
 			}
 		}else{
 			rx_uni_pkt.ttl -= 1;
-			if(rx_uni_pkt.ttl <= 0 && node_id != SINK_ID){
-				//@warning TTL expired and we are not node 1.
+			if(rx_uni_pkt.ttl <= 0){
+				//@warning TTL expired and we are not a sink.
 				//Discard packet and do not do anything.
 				printf("Expired TTL, discarding data packet:\n");
 				printf("DataType: %d Data: %d\n", rx_uni_pkt.data_type, rx_uni_pkt.data);
@@ -595,6 +2195,21 @@ static void unicast_recv(struct unicast_conn *c, const linkaddr_t *from){
 				leds_off(RX_PKT_COLOR);
 				return;
 			}
+			if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+				///@warning Datapath validation: the sender should be further from the sink than us, and we shouldn't be on the path yet.
+				for(i=0;i<TOTAL_NODES && rx_uni_pkt.path[i] != 0 && rx_uni_pkt.path[i] != node_id;i++);
+				if(i < TOTAL_NODES && rx_uni_pkt.path[i] == node_id){
+					printf(RED"Routing loop detected, dropping path over parent %d!\n"RESET, tree_parent);
+					if(tree_parent != 0){
+						neighbour_path_cost[tree_parent-1] = DIJKSTRA_INFINITY;///@warning Until it advertises its cost again.
+					}
+					tree_select_parent();
+					hello_inconsistent();
+				}else if(rx_uni_pkt.path_cost <= tree_cost){
+					printf("Path cost of %d (%d) not above ours (%d), inconsistent tree!\n", from->u8[1], rx_uni_pkt.path_cost, tree_cost);
+					hello_inconsistent();
+				}
+			}
 			for(i=0;i<TOTAL_NODES;i++){
 				if(rx_uni_pkt.path[i] != 0){
 					printf("Path taken so far: %d -> ", rx_uni_pkt.path[i]);
@@ -604,75 +2219,74 @@ static void unicast_recv(struct unicast_conn *c, const linkaddr_t *from){
 					break;
 				}
 			}
-			printf("DEBUG: node_links_cost[node_id-1][SINK_ID-1]: %d\n", lsdb.node_links_cost[node_id-1][SINK_ID-1]);
-			if(lsdb.node_links_cost[node_id-1][SINK_ID-1]>0){
-				///@warning We have a direct link to the sink!
-				printf("We have a direct link to the sink!\n");
-				dst_t.u8[0] = 0;
-				dst_t.u8[1] = SINK_ID;
-				printf("Data packet send to: %d\n", dst_t.u8[1]);
-				packetbuf_copyfrom(&rx_uni_pkt, sizeof(rx_uni_pkt));
-				leds_on(TX_PKT_COLOR);
-				unicast_send(&unicast, &dst_t);
-				leds_off(TX_PKT_COLOR);
-			}else{
-				///@warning We don't have a direct link to the sink!
-				printf("We don't have a direct link to the sink!\n");
-				dst_t.u8[0] = 0;
-				dst_t.u8[1] = 0;
-				//for(i=2;i<TOTAL_NODES;i+=2){ KEEP IT SIMPLE AT BEGINNING
-				for(i=0;i<TOTAL_NODES;i++){
-					//We dont have a direct link to 1 so we start at 2.
-					//We are not gonna send to a sensor mote.
-					next_hop[i] = 0;
-					if(lsdb.node_links_cost[node_id-1][i]  > 0 && lsdb.node_links_cost[i][SINK_ID-1]>0 && i+1!=from->u8[1]){
-						//If i have a link to someone and that someone to the sink.
-						//Dont send to the one you received from
-						next_hop[i] = lsdb.node_links_cost[node_id-1][i];
-					}
-				}
-				max = 0;
-				for(i=0;i<TOTAL_NODES;i++){
-					//Find best next hop of the ones adjacent to 1.
-					if(max < next_hop[i]){
-						max = next_hop[i];
-						dst_t.u8[1] = i+1;
-					}
-				}
-				if(dst_t.u8[1] == 0){
-					printf("We don't have a direct link and none of our neighbours has a direct link to the sink!\n");
-					//I know this is not very efficient and does not really prevent infinite routing loops, BUT
-					//it is only supposed to work for a limited number of hops.
-					///Dont send from where you received.
-					///We don't have a direct link to the sink. Send to bridge with highest battery left.
-					max = 0;
-					for(i=0;i<TOTAL_NODES;i++){
-						if(max < lsdb.node_links_cost[node_id-1][i] && i+1!=from->u8[1]){
-							max = lsdb.node_links_cost[node_id-1][i];
-							dst_t.u8[1] = i+1;
-						}
-					}
-				}
-				printf("Data packet send to: %d\n", dst_t.u8[1]);
-				packetbuf_copyfrom(&rx_uni_pkt, sizeof(rx_uni_pkt));
-				leds_on(TX_PKT_COLOR);
-				unicast_send(&unicast, &dst_t);
-				leds_off(TX_PKT_COLOR);
+			entry = alloc_entry(BUFFER_DATA);
+			if(entry != NULL){
+				entry->packet.data = rx_uni_pkt;
+				send_data(entry, from->u8[1], false);
 			}
 		}
 	}
 	leds_off(RX_PKT_COLOR);
 }
 
+/**@brief Callback function when a unicast was sent, feeds the link estimator.*/
+static void sent_unicast(struct unicast_conn *c, int status, int num_tx){
+	const linkaddr_t *dst = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+	unicast_to = 0;
+	release_tx_power();
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);///@warning The next unicast can go now.
+	if(linkaddr_cmp(dst, &linkaddr_null) || dst->u8[1] == 0 || dst->u8[1] > TOTAL_NODES){
+		return;
+	}
+	if(status == MAC_TX_OK){
+		LinkEstimatorTx(&estimator, dst->u8[1], num_tx, true);
+		tx_failures[dst->u8[1]-1] = 0;
+		piggybacked |= 1 << (dst->u8[1]-1);
+	}else if(status == MAC_TX_NOACK){
+		LinkEstimatorTx(&estimator, dst->u8[1], num_tx, false);
+		link_failed(dst->u8[1], 1);
+	}
+	if(last_data_to != 0){///@warning Only one unicast is out, this report is about last_data.
+		last_data_to = 0;
+		if(status == MAC_TX_NOACK && !last_data->resend){
+			///@warning Send the data packet again over the backup next hop, from the routing process.
+			process_post(&routing_process, data_undelivered_event, NULL);
+		}else{
+			BufferFree(&buffer, last_data);
+			last_data = NULL;
+		}
+	}
+}
+
 static void sent_runicast(struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
 	printf("Runicast message sent to %d, (RE)-TRANSMISSIONS: %d\n", to->u8[1], retransmissions);
+	count_flood_retransmissions(retransmissions);
+	LinkEstimatorTx(&estimator, to->u8[1], retransmissions + 1, true);
+	tx_failures[to->u8[1]-1] = 0;
+	piggybacked |= 1 << (to->u8[1]-1);
+	release_tx_power();
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);///@warning LSAs waiting for runicast can go now.
+}
+
+static void timedout_runicast(struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
+	printf("Runicast message to %d timed out, (RE)-TRANSMISSIONS: %d\n", to->u8[1], retransmissions);
+	count_flood_retransmissions(retransmissions);
+	LinkEstimatorTx(&estimator, to->u8[1], retransmissions + 1, false);
+	link_failed(to->u8[1], LINK_SUSPECT_LIMIT);
+	release_tx_power();
+	process_post(&send_process, PROCESS_EVENT_MSG, 0);///@warning LSAs waiting for runicast can go now.
+}
+
+/**@brief Callback function when a broadcast was sent.*/
+static void sent_broadcast(struct broadcast_conn *c, int status, int num_tx){
+	release_tx_power();
 }
 
 
 // Callback functions
-static struct broadcast_callbacks broadcast_call = {broadcast_recv};
-static struct unicast_callbacks unicast_call = {unicast_recv};
-static struct runicast_callbacks runicast_call = {runicast_recv, sent_runicast};
+static struct broadcast_callbacks broadcast_call = {broadcast_recv, sent_broadcast};
+static struct unicast_callbacks unicast_call = {unicast_recv, sent_unicast};
+static struct runicast_callbacks runicast_call = {runicast_recv, sent_runicast, timedout_runicast};
 
 
 AUTOSTART_PROCESSES(&routing_process, &send_process);
@@ -683,80 +2297,56 @@ PROCESS_THREAD(send_process, ev, data){
 	printf("send_process started!\n");
 
 	static struct etimer t;
-	static struct timer packet_timer;
-	static struct lsa tx_packet;
-	static bool reply_to_send_lsdb_req;
-	static linkaddr_t dst;
-	static bool forward;
-	static uint8_t return_code;
-	static uint8_t is_processing_packet = 0;
-	static clock_time_t remaining_time;
+	static BufferEntry *entry;
+	static uint8_t id;
+	static uint8_t mask;
+	static clock_time_t remaining;
 
 	while(1) {
 		PROCESS_WAIT_EVENT();
 
-		// a new packet has been added to the buffer
-		if (ev == PROCESS_EVENT_MSG) {
-			// is a packet already processed?
-			if ( ! is_processing_packet ) {
-				is_processing_packet = 1;
-				// get a packet from the buffer
-				return_code = BufferOut(&buffer, &tx_packet, &packet_timer, &forward, &reply_to_send_lsdb_req, &dst);
-				// there was nothing in the buffer
-				if (return_code == BUFFER_FAIL){
-					is_processing_packet = 0;
-				}
-				// there was something in the buffer
-				else {
-					remaining_time = timer_remaining(&packet_timer);
-					// check if the timer has already expired
-					if(timer_expired(&packet_timer)){
-						printf("pre backoff expired, in send_process!\n");
-						if(runicast_is_transmitting(&runicast)){
-							printf("Runicast is transmitting other packet, put back in buffer!\n");
-							enqueue_packet(tx_packet, forward, reply_to_send_lsdb_req, dst);
-						}else if(!runicast_is_transmitting(&runicast)){
-							if(reply_to_send_lsdb_req == true){
-								packetbuf_copyfrom(&tx_packet, sizeof(tx_packet));
-								leds_on(TX_PKT_COLOR);
-								runicast_send(&runicast, &dst, RUNICAST_MAX_RETRANSMISSIONS);
-								leds_off(TX_PKT_COLOR);
-								printf("Replying with LSDB link to get LSDB request to: %d%d!\n", dst.u8[0],dst.u8[1]);
-							}else if(reply_to_send_lsdb_req == false){
-								send_runicast_to_neighbours(tx_packet, forward);
-							}
+		// a new packet has been added to the buffer, a runicast finished or a pre-backoff expired
+		if(ev == PROCESS_EVENT_MSG || (ev == PROCESS_EVENT_TIMER && etimer_expired(&t))){
+#if !STUB_IMAGE
+			continue_lsdb_dump();
+#endif
+			///@warning LSAs and unicasts go out one at a time each. Data packets can pass LSAs meanwhile.
+			mask = transmit_mask();
+			// get the next packet from the buffer, by priority of its class
+			// the packet stays in the pool, it is serialized into packetbuf for every neighbour it goes to
+			entry = BufferNext(&buffer, mask);
+			if(entry != NULL){
+				printf("pre backoff expired, in send_process!\n");
+				id = next_fanout(&entry->fanout);
+				if(entry->class == BUFFER_DATA){
+					BufferRemove(&buffer, entry);
+					transmit_data(entry, id);
+					check_congestion();
+				}else if(entry->unicast){
+					BufferRemove(&buffer, entry);
+					transmit_unicast(entry, id);
+					BufferFree(&buffer, entry);///@warning It is in packetbuf now.
+				}else{
+					if(entry->class == BUFFER_CONTROL && lsdb_cost(node_id, id) == 0){
+						printf("Link to %d is gone, not sending the LSA\n", id);
+					}else{
+						transmit_lsa(entry, id);
+						if(entry->class == BUFFER_BULK){
+							printf("Replying with LSDB link to get LSDB request to: %d!\n", id);
 						}
-						is_processing_packet = 0;
-						process_post(&send_process, PROCESS_EVENT_MSG, 0);
 					}
-					else {
-						// wait for the remaining time
-						etimer_set(&t, remaining_time);
-					}
-				}
-			}
-		} else if(ev == PROCESS_EVENT_TIMER){
-			// timer indicating time to send expired
-			if(etimer_expired(&t)){
-				printf("pre backoff expired, in send_process!\n");
-				if(runicast_is_transmitting(&runicast)){
-					printf("Runicast is transmitting other packet, put back in buffer!\n");
-					enqueue_packet(tx_packet, forward, reply_to_send_lsdb_req, dst);
-				}else if(!runicast_is_transmitting(&runicast)){
-					if(reply_to_send_lsdb_req == true){
-						packetbuf_copyfrom(&tx_packet, sizeof(tx_packet));
-						leds_on(TX_PKT_COLOR);
-						runicast_send(&runicast, &dst, RUNICAST_MAX_RETRANSMISSIONS);
-						leds_off(TX_PKT_COLOR);
-						printf("Replying with LSDB link to get LSDB request to: %d%d!\n", dst.u8[0],dst.u8[1]);
-					}else if(reply_to_send_lsdb_req == false){
-						send_runicast_to_neighbours(tx_packet, forward);
+					///@warning One neighbour per runicast, the LSA stays at the head of its queue until all got it.
+					if(entry->fanout == 0){
+						BufferRemove(&buffer, entry);
+						BufferFree(&buffer, entry);
 					}
 				}
-				is_processing_packet = 0;
 				// tell the process to check if there is another packet in the
 				// buffer
 				process_post(&send_process, PROCESS_EVENT_MSG, 0);
+			}else if(BufferNextReady(&buffer, mask, &remaining) == BUFFER_SUCCESS){
+				// wait for the remaining time
+				etimer_set(&t, remaining > 0 ? remaining : 1);
 			}
 		}
 	}
@@ -766,21 +2356,69 @@ PROCESS_THREAD(send_process, ev, data){
 
 PROCESS_THREAD(routing_process, ev, data){
 	PROCESS_EXITHANDLER(unicast_close(&unicast);)
+	static uint8_t i, j;
+	static BufferEntry *entry;
 	PROCESS_BEGIN();
 	printf("routing_process started!\n");
 	node_id = linkaddr_node_addr.u8[1];
+	if(NODE_ROLE != NODE_ROLE_ANY && (am_sink() != is_sink(node_id) || am_sensor() != (node_id % 2 == 0))){
+		///@warning The code of the other roles is compiled out, e.g. a sensor image keeps no LSDB to route with.
+		printf(RED"This image is built for another role than node id %d has, not starting!\n"RESET, node_id);
+		process_exit(&send_process);
+		PROCESS_EXIT();
+	}
+	data_undelivered_event = process_alloc_event();
+	data_epoch = random_rand();///@warning The radio seeds the generator, every boot gets another one.
+	ScheduleInit(&schedule, node_id);
+	BufferInit(&buffer);
+	TrickleInit(&trickle);
+	LinkEstimatorInit(&estimator);
+	FlapDampingInit(&damping);
+
+	/*Warm restart from the last LSDB checkpoint.*/
+	if(LsdbStoreLoad(&lsdb_store, &lsdb, &sequence_number) == LSDB_STORE_SUCCESS){
+		lsdb_restored = true;
+		lsdb_recompute_digest();
+		sequence_number = (sequence_number + LSDB_STORE_SEQ_GAP)%255;///@warning Circular sequence number.
+		print_link_state_database(&lsdb, node_id);
+	}
 
 
 	// Set timers.
-	if(node_id == SINK_ID){
+	if(am_sink() && node_id == SINK_ID){
+		sync_depth = 0;///@warning The first sink is the time reference of the network.
+	}
+	if(am_sink()){
 		etimer_set(&initial_pre_backoff_timer, CLOCK_SECOND);
 	}else{
-		etimer_set(&initial_pre_backoff_timer, INIT_PRE_BACKOFF_PERIOD);
+		etimer_set(&initial_pre_backoff_timer, next_tx_slot(INIT_PRE_BACKOFF_PERIOD));
 	}
 	etimer_set(&keep_alive_timer, KEEP_ALIVE_PERIOD);
 	etimer_set(&down_timer, DOWN_PERIOD);
+	for(i=0;i<TOTAL_NODES;i++){
+		timer_set(&liveness_timer[i], DOWN_PERIOD);
+		neighbour_path_cost[i] = DIJKSTRA_INFINITY;
+	}
+	tree_select_parent();
 	etimer_set(&get_lsdb_timer, GET_LSDB_PERIOD);
 	etimer_set(&sensor_reading_timer, SENSOR_READ_INTERVAL);
+	etimer_set(&checkpoint_timer, LSDB_CHECKPOINT_PERIOD);
+	for(i=0;i<SINK_SENSORS;i++){
+		SummaryInit(&summaries[i]);
+		DeliveryInit(&delivery[i]);
+		LatencyInit(&latency[i].end_to_end);
+		LatencyInit(&latency[i].queued);
+		LatencyInit(&latency[i].air);
+		for(j=0;j<LATENCY_HOPS;j++){
+			LatencyInit(&latency[i].hops[j]);
+		}
+	}
+	memset(reporters_seen, 0, sizeof(reporters_seen));
+	if(am_sink() && summary_interval > 0){
+		etimer_set(&summary_timer, summary_interval);
+	}
+	FloodCostInit(&flood_cost);
+	FloodCostInit(&flood_totals);
 
 	/*Set radio parameters.*/
 	NETSTACK_CONF_RADIO.set_value(RADIO_PARAM_CHANNEL, CHANNEL);
@@ -788,6 +2426,7 @@ PROCESS_THREAD(routing_process, ev, data){
 
 	/*Configure ADC port.*/
 	adc_zoul.configure(SENSORS_HW_INIT, ZOUL_SENSORS_ADC1 | ZOUL_SENSORS_ADC3);
+	SamplingInit(&adc3_sampling);
 
 	/*Open connections.*/
 	broadcast_open(&broadcast, BROADCAST_RIME_CHANNEL, &broadcast_call);
@@ -795,7 +2434,6 @@ PROCESS_THREAD(routing_process, ev, data){
 	runicast_open(&runicast, 144, &runicast_call);
 
 	uint16_t max;
-	uint8_t i;
 	uint8_t get_lsdb;
 	static uint16_t adc3_value;
 	static int sensor_value;
@@ -808,147 +2446,161 @@ PROCESS_THREAD(routing_process, ev, data){
 		PROCESS_WAIT_EVENT();
 		if(ev == serial_line_event_message){
 			if(strcmp(data, "print.lsdb") == 0){
-				print_link_state_database(&lsdb);
+				print_link_state_database(&lsdb, node_id);
 			}else if(strcmp(data, "print.n") == 0){
 				print_neighbour_list(lsdb.neighbours, lsdb.ka_received);
+			}else if(strcmp(data, "print.routes") == 0){
+				print_routing_table();
+			}else if(strcmp(data, "print.queues") == 0){
+				print_queues();
+			}else if(strcmp(data, "print.summary") == 0){
+				print_summaries();
+			}else if(strcmp(data, "print.delivery") == 0){
+				print_delivery();
+			}else if(strcmp(data, "print.floods") == 0){
+				print_floods();
+#if LATENCY_TRACE
+			}else if(strcmp(data, "print.latency") == 0){
+				print_latency();
+#endif
+			}else if(strncmp(data, "summary.interval ", 17) == 0){
+				set_summary_interval(atoi((char *)data + 17));
+			}else if(strcmp(data, "summary.raw on") == 0){
+				summary_raw = true;
+			}else if(strcmp(data, "summary.raw off") == 0){
+				summary_raw = false;
 			}else if(strcmp(data, "whoami") == 0){//hahaha
 				printf("I am: %d\n", node_id);
 			}
+		}else if(ev == data_undelivered_event){
+			if(last_data != NULL && last_data_to == 0){
+				printf("Data packet was not delivered, sending it again\n");
+				entry = last_data;
+				last_data = NULL;///@warning Lets the data class go again, even if the packet is dropped.
+				send_data(entry, entry->from, true);
+				process_post(&send_process, PROCESS_EVENT_MSG, 0);
+			}
+		}else if(ev == PROCESS_EVENT_POLL){
+			///@warning The Trickle timer was reset from a callback, start the new interval.
+			if(etimer_expired(&initial_pre_backoff_timer)){
+				etimer_set(&keep_alive_timer, next_tx_slot(TrickleNext(&trickle)));
+			}
 		}else if(etimer_expired(&keep_alive_timer) && etimer_expired(&initial_pre_backoff_timer)){
-			printf("keep_alive_timer EXPIRED! | I am node: %d | ", node_id);
-			tx_ka_pkt.battery_value = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
-			printf("My battery value: %d\n", tx_ka_pkt.battery_value);
-			tx_ka_pkt.get_lsdb_req = false;
-			memcpy(tx_ka_pkt.neighbours, lsdb.neighbours, sizeof(lsdb.neighbours));
-			packetbuf_copyfrom(&tx_ka_pkt, sizeof(tx_ka_pkt));
-			printf("BROADCAST PACKET SIZE: %d (bytes)\n", sizeof(tx_ka_pkt));
-			broadcast_send(&broadcast);
-			etimer_set(&keep_alive_timer, KEEP_ALIVE_PERIOD);
-			NETSTACK_CONF_RADIO.get_value(RADIO_PARAM_TXPOWER, &tx_power);
-			printf("Broadcast message sent with power: %d\r\n", tx_power);
-
+			if(broadcast_waiting){
+				broadcast_keep_alive();
+			}else if(TrickleFire(&trickle)){
+				if(hello_piggybacked()){
+					printf("Every neighbour got a packet from us, leaving out the keep alive\n");
+				}else{
+					hellos_piggybacked = 0;
+					printf("keep_alive_timer EXPIRED! | I am node: %d | ", node_id);
+					tx_ka_pkt.battery_value = vdd3_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED);
+					printf("My battery value: %d\n", tx_ka_pkt.battery_value);
+					tx_ka_pkt.get_lsdb_req = false;
+					broadcast_keep_alive();
+				}
+			}
+			if(!broadcast_waiting){
+				piggybacked = 0;
+			}
+			///@warning A waiting keep alive is tried again in our next slot, the Trickle interval stays.
+			etimer_set(&keep_alive_timer, next_tx_slot(broadcast_waiting ? 1 : TrickleNext(&trickle)));
 
 		}else if(etimer_expired(&down_timer) && etimer_expired(&initial_pre_backoff_timer)){
-			printf("down_timer EXPIRED!\n");
 			for(i=0;i<TOTAL_NODES;i++){
-				if(lsdb.ka_received[i] == 0){
-					//No keep alives in DOWN_PERIOD.
-					if(lsdb.node_links_cost[node_id-1][i] > 0 || lsdb.node_links_cost[i][node_id-1]>0){
-						//Link was previously up -> Link is now considered down.
-						printf(RED"I have a link down!\n"RESET);
-						sequence_number = (sequence_number + 1)%255;///@warning Circular sequence number.
-						lsdb.neighbours[i] = 0;
-						remove_link_from_lsdb(node_id, i+1, sequence_number);
-					}
-				}else{
-					// Needs to be reset to 0 after every down timer expiration.
-					lsdb.ka_received[i] = 0;
-					lsdb.neighbours[i] = 0;///@warning Check if this screws everything up :)
+				if(i+1 == node_id || !timer_expired(&liveness_timer[i]) || !is_neighbour(i+1)){
+					continue;
 				}
+				//Missed the keep alives the neighbour promised.
+				printf("No keep alive from %d in time!\n", i+1);
+				neighbour_down(i+1);
 			}
-			etimer_set(&down_timer, DOWN_PERIOD);
+			report_floods();
+			etimer_set(&down_timer, TRICKLE_IMIN);
 
 		}else if(etimer_expired(&sensor_reading_timer) && etimer_expired(&initial_pre_backoff_timer)){
-			/*Read ADC values. Data is in the 12 MSBs.*/
-			if(node_id%2==0){
-			adc3_value = adc_zoul.value(ZOUL_SENSORS_ADC3) >> 4;
-			printf("ADC3 value [Raw] = %d\n", adc3_value);
-			}
-
-			switch(node_id){
-				case 2: sensor_value = cc2538_temp_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED); break;
-				case 4: sensor_value = (int)getSoilMoisture1(adc3_value); break;
-				case 6: sensor_value = (int)getSoilMoisture2(adc3_value); break;
-				case 8: sensor_value = (int)getLightSensorValue(adc3_value); break;
-				case 10: sensor_value = (int)getpHlevel(adc3_value); break;
-				case 12: sensor_value = (int)getHumidityValue(adc3_value); break;
-			}
-			if(node_id%2==0){
+			if(am_sensor()){
+				/*Read ADC values.*/
+				adc3_value = read_adc(&adc3_sampling, ZOUL_SENSORS_ADC3, "ADC3");
+
+				switch(node_id){
+					case 2: sensor_value = cc2538_temp_sensor.value(CC2538_SENSORS_VALUE_TYPE_CONVERTED); break;
+					case 4: sensor_value = (int)getSoilMoisture1(adc3_value); break;
+					case 6: sensor_value = (int)getSoilMoisture2(adc3_value); break;
+					case 8: sensor_value = (int)getLightSensorValue(adc3_value); break;
+					case 10: sensor_value = (int)getpHlevel(adc3_value); break;
+					case 12: sensor_value = (int)getHumidityValue(adc3_value); break;
+				}
 				//Only write to buffer if we have to.
 				printf("Sensor value converted: %d\n", sensor_value);
-				tx_uni_pkt.data_packet = true;
-				tx_uni_pkt.data_type = node_id;
-				tx_uni_pkt.data = sensor_value;
-				tx_uni_pkt.path[0] = node_id;
-				tx_uni_pkt.ttl = TTL;
-				printf("Data packet size: (%d) bytes\n", sizeof(tx_uni_pkt));
-				packetbuf_copyfrom(&tx_uni_pkt, sizeof(tx_uni_pkt));
-				sensor_dest.u8[1] = SINK_ID;
-				if(lsdb.node_links_cost[node_id-1][sensor_dest.u8[1]-1]>0){
-					///We have a direct link to the sink.
-					printf("We have a direct link to the sink!\n");
-					printf("Data packet send to: %d\n", sensor_dest.u8[1]);
-					leds_on(TX_PKT_COLOR);
-					unicast_send(&unicast, &sensor_dest);
-					leds_off(TX_PKT_COLOR);
-				}else if(lsdb.node_links_cost[node_id-1][sensor_dest.u8[1]-1] == 0){
-					///We don't have a direct link to the sink. Send to bridge with highest battery left.
-					printf("We don't have a direct link to the sink!\n");
-					max = 0;
-					for(i=0;i<TOTAL_NODES;i++){
-						if(max < lsdb.node_links_cost[node_id-1][i]){
-							max = lsdb.node_links_cost[node_id-1][i];
-							sensor_dest.u8[1] = i+1;
-						}
-					}
-					if(sensor_dest.u8[1] != SINK_ID){///Since we don't have a link to one.
-						printf("Data packet send to: %d\n", sensor_dest.u8[1]);
-						leds_on(TX_PKT_COLOR);
-						unicast_send(&unicast, &sensor_dest);
-						leds_off(TX_PKT_COLOR);
-					}
-				}
+				add_reading(sensor_value);
+			}
+			etimer_set(&sensor_reading_timer, next_tx_slot(sensor_read_interval()));
+
+		}else if(etimer_expired(&checkpoint_timer) && etimer_expired(&initial_pre_backoff_timer)){
+			if(LsdbStoreSave(&lsdb_store, &lsdb, sequence_number) == LSDB_STORE_FAIL){
+				printf("Writing LSDB checkpoint failed!\n");
 			}
-			etimer_set(&sensor_reading_timer, SENSOR_READ_INTERVAL);
+			etimer_set(&checkpoint_timer, LSDB_CHECKPOINT_PERIOD);
+
+		}else if(am_sink() && summary_interval > 0 && etimer_expired(&summary_timer)){
+			print_summaries();
+			print_delivery();
+#if LATENCY_TRACE
+			print_latency();
+#endif
+			etimer_set(&summary_timer, summary_interval);
 
 		}else if(etimer_expired(&get_lsdb_timer) && etimer_expired(&initial_pre_backoff_timer)){
 			printf("get_lsdb_timer EXPIRED!\n");
-			etimer_restart(&keep_alive_timer);
-			etimer_restart(&sensor_reading_timer);
-			etimer_restart(&down_timer);
+			etimer_set(&sensor_reading_timer, next_tx_slot(sensor_read_stagger()));
 			max = 0;
 			get_lsdb = 0;
 
-			if(lsdb.neighbours[0] != SINK_ID){///@warning No need to get the LSDB of neighbours, if we are adjacent to the sink.
+			if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+				printf("Collection tree mode, not getting a LSDB!\n");
+			}else if(!lists_sink(lsdb.neighbours)){///@warning No need to get the LSDB of neighbours, if we are adjacent to a sink.
 				for(i=0;i<TOTAL_NODES;i++){
 					if(max < rx_ages[i]){
 						max = rx_ages[i];
 						get_lsdb = i+1;
 					}
 				}
+				if(lsdb_restored && max <= lsdb.age){
+					///@warning Our restored LSDB is as new as the ones around us, no need to pull one.
+					printf("Keeping restored LSDB (age %d), neighbours have at most %d\n", lsdb.age, max);
+					get_lsdb = 0;
+				}
 				if(get_lsdb > 0){///@warning Only send unicast if node id not 0.
-					dst_t.u8[0] = 0;
-					dst_t.u8[1] = get_lsdb;
-					printf("GET LSDB FROM: %d\n", dst_t.u8[1]);
-					tx_uni_pkt.data_packet = false;
-					tx_uni_pkt.send_lsdb = true;
-					tx_uni_pkt.lsdb_age = 0;
-					packetbuf_copyfrom(&tx_uni_pkt, sizeof(tx_uni_pkt));
-					leds_on(TX_PKT_COLOR);
-					unicast_send(&unicast, &dst_t);
-					leds_off(TX_PKT_COLOR);
+#if STUB_IMAGE
+					printf("Stub node, not getting the LSDB of %d!\n", get_lsdb);///@warning Nobody sends a LSDB to a stub node.
+#else
+					send_lsdb_request(get_lsdb);
+#endif
 				}else if(get_lsdb == 0){
 					printf("GOT NO AGE REPLIES!\n");
 				}
 			}else{
-				printf("Not getting LSDB from neighbours, since we are adjacent to node 1!\n");
+				printf("Not getting LSDB from neighbours, since we are adjacent to a sink!\n");
 			}
 		}else if(etimer_expired(&initial_pre_backoff_timer)){
 			printf("initial_pre_backoff_timer EXPIRED!\n");
-			sequence_number = RESET_SQN_NO;
-			lsdb.age = 0;
-			if(node_id % 2 != 0){
+			if(!lsdb_restored){
+				sequence_number = RESET_SQN_NO;
+				lsdb.age = 0;
+			}
+			if(ROUTING_MODE == ROUTING_MODE_COLLECTION_TREE){
+				printf("Collection tree mode, no LSDB to ask for!\n");
+			}else if(!am_sensor()){
 				printf("Asking for LSDB Ages!\n");
 				tx_ka_pkt.get_lsdb_req = true;
-				memcpy(tx_ka_pkt.neighbours, lsdb.neighbours, sizeof(lsdb.neighbours));
-				packetbuf_copyfrom(&tx_ka_pkt, sizeof(tx_ka_pkt));
-				broadcast_send(&broadcast);
+				broadcast_keep_alive();
 			}else{
 				printf("Not asking for LSDB Ages, since we are a sensor mote!\n");
 			}
-			etimer_restart(&keep_alive_timer);
-			etimer_restart(&sensor_reading_timer);
-			etimer_restart(&down_timer);
+			etimer_set(&keep_alive_timer, next_tx_slot(broadcast_waiting ? 1 : TrickleNext(&trickle)));
+			etimer_set(&sensor_reading_timer, next_tx_slot(sensor_read_stagger()));
+			etimer_set(&down_timer, TRICKLE_IMIN);
 			//etimer_restart(&get_lsdb_timer);
 		}
 	}
@@ -0,0 +1,76 @@
+
+#include "sample_batch.h"
+#include <string.h>
+
+// 7 bits per byte, the highest bit set if another byte follows
+static uint8_t SampleBatchPutVarint(uint8_t *bytes, uint16_t value)
+{
+	uint8_t n = 0;
+
+	while (value >= 0x80) {
+		bytes[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	bytes[n++] = value;
+	return n;
+}
+
+static uint8_t SampleBatchGetVarint(const uint8_t *bytes, uint8_t length, uint8_t *offset, uint16_t *value)
+{
+	uint8_t shift = 0;
+
+	*value = 0;
+	while (*offset < length && shift < 16) {
+		*value |= (uint16_t)(bytes[*offset] & 0x7F) << shift;
+		if ((bytes[(*offset)++] & 0x80) == 0)
+			return SAMPLE_BATCH_SUCCESS;
+		shift += 7;
+	}
+	return SAMPLE_BATCH_FAIL;
+}
+
+void SampleBatchInit(SampleBatch *batch)
+{
+	batch->count = 0;
+	batch->length = 0;
+}
+
+uint8_t SampleBatchAdd(SampleBatch *batch, uint16_t value, uint16_t time)
+{
+	uint8_t encoded[6];
+	uint8_t n;
+	int16_t delta;
+
+	if (batch->count == 0) {
+		batch->first = value;
+		batch->first_time = time;
+	} else {
+		if (batch->count == 255)
+			return SAMPLE_BATCH_FAIL;
+		// zigzag: small changes either way give small numbers
+		delta = (int16_t)(value - batch->last);
+		n = SampleBatchPutVarint(encoded, (uint16_t)(time - batch->last_time));
+		n += SampleBatchPutVarint(encoded + n, ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+		if (batch->length + n > SAMPLE_BATCH_BYTES)
+			return SAMPLE_BATCH_FAIL;
+		memcpy(batch->bytes + batch->length, encoded, n);
+		batch->length += n;
+	}
+	batch->last = value;
+	batch->last_time = time;
+	batch->count++;
+	return SAMPLE_BATCH_SUCCESS;
+}
+
+uint8_t SampleBatchNext(const uint8_t *bytes, uint8_t length, uint8_t *offset, uint16_t *value, uint16_t *time)
+{
+	uint16_t elapsed;
+	uint16_t zigzag;
+
+	if (SampleBatchGetVarint(bytes, length, offset, &elapsed) == SAMPLE_BATCH_FAIL ||
+			SampleBatchGetVarint(bytes, length, offset, &zigzag) == SAMPLE_BATCH_FAIL)
+		return SAMPLE_BATCH_FAIL;
+	*time += elapsed;
+	*value += (zigzag >> 1) ^ (uint16_t)-(int16_t)(zigzag & 1);
+	return SAMPLE_BATCH_SUCCESS;
+}
@@ -0,0 +1,45 @@
+/**@file sample_batch.h*/
+
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**Return code for batch failure.*/
+#define SAMPLE_BATCH_FAIL 0
+
+/**Return code for batch success.*/
+#define SAMPLE_BATCH_SUCCESS 1
+
+/**@brief Samples of a sensor mote, sent together in one data packet.
+ * The first sample is kept as it is. Every further one is encoded against the one before:
+ * the seconds since it as a varint, then the change of the value as a zigzag varint.
+ * Slowly changing values and a steady read interval take two bytes per sample.*/
+typedef struct
+{
+	uint16_t first;/**<Value of the first sample.*/
+	uint16_t first_time;/**<Network time (seconds, wraps around) of the first sample.*/
+	uint16_t last;/**<Value of the last sample.*/
+	uint16_t last_time;/**<Network time of the last sample.*/
+	uint8_t count;/**<Number of samples.*/
+	uint8_t length;/**<Bytes used in bytes.*/
+	uint8_t bytes[SAMPLE_BATCH_BYTES];/**<Encoded samples after the first.*/
+}SampleBatch;
+
+// empties the batch
+void SampleBatchInit(SampleBatch *batch);
+
+// adds a sample
+// returns SAMPLE_BATCH_FAIL if it doesn't fit any more
+uint8_t SampleBatchAdd(SampleBatch *batch, uint16_t value, uint16_t time);
+
+// decodes the sample after value and time from bytes at offset, advancing offset
+// returns SAMPLE_BATCH_FAIL at the end of the bytes or if they are broken
+uint8_t SampleBatchNext(const uint8_t *bytes, uint8_t length, uint8_t *offset, uint16_t *value, uint16_t *time);
+
+#endif /* SAMPLE_BATCH_H */
@@ -0,0 +1,111 @@
+
+#include "sampling.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void SamplingInit(Sampling *sampling)
+{
+	sampling->average = 0;
+	sampling->valid = false;
+}
+
+uint16_t SamplingMedian(uint16_t *samples, uint8_t n)
+{
+	uint8_t i, j;
+	uint16_t sample;
+
+	if (n == 0)
+		return 0;
+	// insertion sort, bursts are short
+	for (i = 1; i < n; i++) {
+		sample = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > sample; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = sample;
+	}
+	if (n % 2 == 0)
+		return ((uint32_t)samples[n / 2 - 1] + samples[n / 2] + 1) / 2;
+	return samples[n / 2];
+}
+
+uint16_t SamplingAdd(Sampling *sampling, uint16_t *samples, uint8_t n)
+{
+	int32_t median = (int32_t)SamplingMedian(samples, n) << SAMPLING_FRACTION_BITS;
+
+	if (!sampling->valid || labs(median - sampling->average) > ((int32_t)SAMPLING_STEP << SAMPLING_FRACTION_BITS)) {
+		sampling->average = median;
+		sampling->valid = true;
+	} else {
+		sampling->average += (median - sampling->average) / SAMPLING_EWMA;
+	}
+	// round to the nearest raw value
+	return (sampling->average + (1 << (SAMPLING_FRACTION_BITS - 1))) >> SAMPLING_FRACTION_BITS;
+}
+
+#ifndef CONTIKI
+#include <string.h>
+
+// Host harness: feeds a recorded ADC trace through the filter.
+// The trace is a mote log, read from the file given or stdin. Only the lines
+// starting with "<channel> samples:" are taken, every one of them is a burst of
+// SAMPLING_OVERSAMPLE samples. The channel is ADC3 unless given, e.g.
+//   ./sampling ADC1 traces/sampling.log
+int main(int argc, char **argv) {
+	FILE *trace = stdin;
+	const char *channel = argc > 1 ? argv[1] : "ADC3";
+	char prefix[32];
+	char line[256];
+	Sampling sampling;
+	uint16_t burst[SAMPLING_OVERSAMPLE];
+	uint16_t first, median, filtered;
+	uint16_t last_first = 0, last_filtered = 0;
+	uint32_t jitter_raw = 0, jitter_filtered = 0;
+	uint16_t bursts = 0;
+	uint8_t n;
+	long sample;
+	char *word, *end;
+
+	if (argc > 2 && (trace = fopen(argv[2], "r")) == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+	snprintf(prefix, sizeof(prefix), "%s samples:", channel);
+	SamplingInit(&sampling);
+	printf("%s\n", channel);
+	printf("burst first median filtered\n");
+	while (fgets(line, sizeof(line), trace) != NULL) {
+		if (strncmp(line, prefix, strlen(prefix)) != 0)
+			continue;
+		n = 0;
+		word = line + strlen(prefix);
+		while (n < SAMPLING_OVERSAMPLE) {
+			sample = strtol(word, &end, 10);
+			if (end == word || sample < 0 || sample > 0xFFFF)
+				break;
+			burst[n++] = sample;
+			word = end;
+		}
+		// a line cut short by the serial line is not a burst
+		if (n < SAMPLING_OVERSAMPLE) {
+			fprintf(stderr, "Skipping a burst of %d samples\n", n);
+			continue;
+		}
+		first = burst[0];
+		filtered = SamplingAdd(&sampling, burst, SAMPLING_OVERSAMPLE);
+		median = SamplingMedian(burst, SAMPLING_OVERSAMPLE);
+		if (bursts > 0) {
+			jitter_raw += abs((int)first - last_first);
+			jitter_filtered += abs((int)filtered - last_filtered);
+		}
+		last_first = first;
+		last_filtered = filtered;
+		printf("%5d %5d %6d %8d\n", bursts++, first, median, filtered);
+	}
+	if (bursts > 1)
+		printf("Mean change between readings: single sample %.1f, filtered %.1f\n",
+		       (double)jitter_raw / (bursts - 1), (double)jitter_filtered / (bursts - 1));
+	if (trace != stdin)
+		fclose(trace);
+	return 0;
+}
+#endif
@@ -0,0 +1,32 @@
+/**@file sampling.h*/
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Filter of one ADC channel.
+ * Every reading is a burst of SAMPLING_OVERSAMPLE samples. The median of the burst drops
+ * single spikes, an EWMA over the medians of the bursts smooths the noise. The average is kept
+ * with SAMPLING_FRACTION_BITS fractional bits, so it doesn't get stuck next to the real value.
+ * A median further than SAMPLING_STEP from the average restarts it, real changes show right away.*/
+typedef struct
+{
+	int32_t average;/**<EWMA of the medians, times 2^SAMPLING_FRACTION_BITS.*/
+	bool valid;/**<True once a burst was added.*/
+}Sampling;
+
+// forgets the average
+void SamplingInit(Sampling *sampling);
+
+// returns the median of n samples, sorts them
+uint16_t SamplingMedian(uint16_t *samples, uint8_t n);
+
+// adds a burst of n samples, sorts them
+// returns the filtered value
+uint16_t SamplingAdd(Sampling *sampling, uint16_t *samples, uint8_t n);
+
+#endif /* SAMPLING_H */
@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# Bash script to check the ADC filter on the host, against the traces in traces/
+# Every traces/<trace>_<channel>.expected is the output of the harness in sampling.c
+# for channel <channel> of traces/<trace>.log
+
+RED='\033[0;31m'
+NC='\033[0m' # No Color
+
+cd "$(dirname "$0")" || exit 1
+harness=$(mktemp) || exit 1
+trap 'rm -f "$harness"' EXIT
+
+gcc -Wall -I. sampling.c -o "$harness" || exit 1
+
+status=0
+for expected in traces/*_*.expected
+do
+	name=$(basename "$expected" .expected)
+	channel=$(echo "${name##*_}" | tr a-z A-Z)
+	trace=traces/${name%_*}.log
+	if "$harness" "$channel" "$trace" 2>/dev/null | diff -u "$expected" -
+	then
+		echo "$trace $channel: OK"
+	else
+		echo -e "${RED}$trace $channel: FAILED${NC}"
+		status=1
+	fi
+done
+exit $status
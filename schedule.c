@@ -0,0 +1,84 @@
+
+#include "schedule.h"
+#include <stdio.h>
+#include <string.h>
+
+// slot a node uses, the one of its node id until we heard otherwise
+static uint8_t ScheduleSlotOf(Schedule *schedule, uint8_t id)
+{
+	if (schedule->slots[id - 1] != SCHEDULE_UNKNOWN)
+		return schedule->slots[id - 1];
+	return (id - 1) % SLOT_FRAME_LENGTH;
+}
+
+static void ScheduleAssignSlot(Schedule *schedule)
+{
+	uint8_t id;
+	uint8_t tries;
+	bool conflict;
+
+	schedule->slot = (schedule->owner - 1) % SLOT_FRAME_LENGTH;
+	for (tries = 0; tries < SLOT_FRAME_LENGTH; tries++) {
+		// is the slot taken by a node with a lower id within two hops?
+		conflict = false;
+		for (id = 1; id < schedule->owner; id++) {
+			if ((schedule->neighbourhood & (1 << (id - 1))) && ScheduleSlotOf(schedule, id) == schedule->slot)
+				conflict = true;
+		}
+		if (!conflict)
+			break;
+		schedule->slot = (schedule->slot + 1) % SLOT_FRAME_LENGTH;
+	}
+}
+
+void ScheduleInit(Schedule *schedule, uint8_t node_id)
+{
+	schedule->owner = node_id;
+	schedule->neighbourhood = 0;
+	memset(schedule->slots, SCHEDULE_UNKNOWN, sizeof(schedule->slots));
+	ScheduleAssignSlot(schedule);
+}
+
+void ScheduleAddNeighbour(Schedule *schedule, uint8_t node_id, uint8_t slot)
+{
+	uint8_t old_slot = schedule->slot;
+
+	if (node_id == 0 || node_id > TOTAL_NODES || node_id == schedule->owner)
+		return;
+
+	schedule->neighbourhood |= 1 << (node_id - 1);
+	if (slot < SLOT_FRAME_LENGTH)
+		schedule->slots[node_id - 1] = slot;
+	ScheduleAssignSlot(schedule);
+	if (schedule->slot != old_slot)
+		printf("Transmit slot changed: %d -> %d\n", old_slot, schedule->slot);
+}
+
+void ScheduleClearNeighbourhood(Schedule *schedule)
+{
+	schedule->neighbourhood = 0;
+	ScheduleAssignSlot(schedule);
+}
+
+void ScheduleAdvertise(Schedule *schedule, uint8_t slots[TOTAL_NODES])
+{
+	memcpy(slots, schedule->slots, TOTAL_NODES);
+	slots[schedule->owner - 1] = schedule->slot;
+}
+
+clock_time_t ScheduleNextSlot(Schedule *schedule, clock_time_t now, clock_time_t earliest)
+{
+	clock_time_t frame = (clock_time_t)SLOT_FRAME_LENGTH * SLOT_DURATION;
+	clock_time_t slot_start = (clock_time_t)schedule->slot * SLOT_DURATION;
+	clock_time_t position = (now + earliest) % frame;
+	clock_time_t wait;
+
+	// wait for the start of our slot in this or the next frame
+	if (position <= slot_start)
+		wait = slot_start - position;
+	else
+		wait = frame - position + slot_start;
+
+	// jitter within the slot, so CSMA can sort out nodes that still share it
+	return earliest + wait + random_rand() % SLOT_JITTER;
+}
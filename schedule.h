@@ -0,0 +1,54 @@
+/**@file schedule.h*/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "contiki.h"
+#include "lib/random.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+#if TOTAL_NODES > 16
+#error "The neighbourhood of the transmit schedule is a 16 bit mask."
+#endif
+
+/**Slot of a node we didn't hear about yet, the slot of its node id is assumed.*/
+#define SCHEDULE_UNKNOWN 0xFF
+
+/**@brief Transmit schedule of a node.
+ * The network time is divided in frames of SLOT_FRAME_LENGTH slots of SLOT_DURATION.
+ * Every node transmits only in its own slot, which starts at the one of its node id.
+ * If a node within two hops with a lower node id uses the same slot, we move on to the
+ * next slot, so nodes that can collide at a common neighbour don't share a slot.
+ * Nodes advertise the slots they use in their keep alives, together with the ones of
+ * their neighbours, so we compare with the slots nodes moved to, not their first ones.*/
+typedef struct
+{
+	uint8_t owner;/**<Node id of the node the schedule belongs to.*/
+	uint8_t slot;/**<Slot we transmit in.*/
+	uint16_t neighbourhood;/**<Bit i set if node i+1 is within two hops.*/
+	uint8_t slots[TOTAL_NODES];/**<Slot node X advertised last, SCHEDULE_UNKNOWN if none.*/
+}Schedule;
+
+// sets up the schedule of node_id with an empty neighbourhood
+void ScheduleInit(Schedule *schedule, uint8_t node_id);
+
+// adds a node within two hops to the neighbourhood, using slot, and updates our slot
+// SCHEDULE_UNKNOWN keeps the slot it advertised before
+void ScheduleAddNeighbour(Schedule *schedule, uint8_t node_id, uint8_t slot);
+
+// forgets the neighbourhood, our slot falls back to the one of our node id
+// the slots nodes advertised are kept
+void ScheduleClearNeighbourhood(Schedule *schedule);
+
+// fills the slots to advertise in a keep alive, ours and the ones we know of
+void ScheduleAdvertise(Schedule *schedule, uint8_t slots[TOTAL_NODES]);
+
+// returns the delay from now until the start of our first slot that is at least
+// earliest ticks away, plus a random jitter within the slot
+clock_time_t ScheduleNextSlot(Schedule *schedule, clock_time_t now, clock_time_t earliest);
+
+#endif /* SCHEDULE_H */
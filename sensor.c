@@ -0,0 +1,7 @@
+/** @file sensor.c
+ * @brief Firmware image of a sensor mote. Reads and sends its sensor, without the sink code and with smaller queues.
+ * See NODE_ROLE in project-conf.h.*/
+
+#define NODE_ROLE NODE_ROLE_SENSOR
+
+#include "routing.c"
@@ -0,0 +1,7 @@
+/** @file sink.c
+ * @brief Firmware image of a sink. Prints the data arriving for the GUI.
+ * See NODE_ROLE in project-conf.h.*/
+
+#define NODE_ROLE NODE_ROLE_SINK
+
+#include "routing.c"
@@ -0,0 +1,85 @@
+
+#include "summary.h"
+#include <string.h>
+
+static const uint32_t summary_windows[SUMMARY_WINDOW_COUNT] = SUMMARY_WINDOWS;
+
+static uint32_t SummaryStep(uint8_t window)
+{
+	uint32_t step = summary_windows[window] / SUMMARY_BUCKETS;
+
+	return step > 0 ? step : 1;
+}
+
+void SummaryInit(Summary *summary)
+{
+	memset(summary, 0, sizeof(Summary));
+}
+
+void SummaryAdd(Summary *summary, uint16_t value, uint32_t time)
+{
+	uint8_t w;
+	uint32_t epoch;
+	SummaryBucket *bucket;
+
+	for (w = 0; w < SUMMARY_WINDOW_COUNT; w++) {
+		epoch = time / SummaryStep(w);
+		bucket = &summary->buckets[w][epoch % SUMMARY_BUCKETS];
+		if (bucket->count > 0 && bucket->epoch != epoch) {
+			// readings arrive out of order, one older than the step here is out of the window
+			if (epoch < bucket->epoch)
+				continue;
+			bucket->count = 0;
+		}
+		if (bucket->count == 0) {
+			bucket->epoch = epoch;
+			bucket->sum = 0;
+			bucket->min = value;
+			bucket->max = value;
+		}
+		bucket->sum += value;
+		if (value < bucket->min)
+			bucket->min = value;
+		if (value > bucket->max)
+			bucket->max = value;
+		if (bucket->count < 0xFFFF)
+			bucket->count++;
+	}
+	if (!summary->valid || time >= summary->last_time) {
+		summary->last = value;
+		summary->last_time = time;
+	}
+	summary->total++;
+	summary->valid = true;
+}
+
+uint32_t SummaryWindow(uint8_t window)
+{
+	return summary_windows[window];
+}
+
+uint8_t SummaryGet(const Summary *summary, uint8_t window, uint32_t now, SummaryStats *stats)
+{
+	uint32_t epoch = now / SummaryStep(window);
+	uint32_t sum = 0;
+	uint32_t count = 0;
+	const SummaryBucket *bucket;
+	uint8_t b;
+
+	for (b = 0; b < SUMMARY_BUCKETS; b++) {
+		bucket = &summary->buckets[window][b];
+		if (bucket->count == 0 || bucket->epoch > epoch || bucket->epoch + SUMMARY_BUCKETS <= epoch)
+			continue;
+		if (count == 0 || bucket->min < stats->min)
+			stats->min = bucket->min;
+		if (count == 0 || bucket->max > stats->max)
+			stats->max = bucket->max;
+		sum += bucket->sum;
+		count += bucket->count;
+	}
+	if (count == 0)
+		return SUMMARY_FAIL;
+	stats->mean = (sum + count / 2) / count;
+	stats->count = count < 0xFFFF ? count : 0xFFFF;
+	return SUMMARY_SUCCESS;
+}
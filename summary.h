@@ -0,0 +1,64 @@
+/**@file summary.h*/
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include "contiki.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**Return code for summary failure.*/
+#define SUMMARY_FAIL 0
+
+/**Return code for summary success.*/
+#define SUMMARY_SUCCESS 1
+
+/**@brief Readings of a sensor in one step of a window.*/
+typedef struct
+{
+	uint32_t epoch;/**<Time of the readings divided by the length of a step.*/
+	uint32_t sum;/**<Sum of the readings.*/
+	uint16_t min;/**<Lowest reading.*/
+	uint16_t max;/**<Highest reading.*/
+	uint16_t count;/**<Number of readings.*/
+}SummaryBucket;
+
+/**@brief Statistics of a sensor over one window.*/
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+	uint16_t count;
+}SummaryStats;
+
+/**@brief Rolling statistics of the readings of one sensor, kept by the sink.
+ * Every window of SUMMARY_WINDOWS is split in SUMMARY_BUCKETS steps, a reading goes in
+ * the step of its sample time. The statistics of a window are those of its last
+ * SUMMARY_BUCKETS steps, so it moves on one step at a time and the memory stays fixed.*/
+typedef struct
+{
+	SummaryBucket buckets[SUMMARY_WINDOW_COUNT][SUMMARY_BUCKETS];
+	uint16_t last;/**<Newest reading.*/
+	uint32_t last_time;/**<Sample time (seconds) of the newest reading.*/
+	uint32_t total;/**<Readings since the sink booted.*/
+	bool valid;/**<True once a reading was added.*/
+}Summary;
+
+// forgets all readings
+void SummaryInit(Summary *summary);
+
+// adds a reading sampled at time (seconds)
+void SummaryAdd(Summary *summary, uint16_t value, uint32_t time);
+
+// returns the length (seconds) of a window
+uint32_t SummaryWindow(uint8_t window);
+
+// statistics of a window ending at now (seconds)
+// returns SUMMARY_FAIL if there was no reading in it
+uint8_t SummaryGet(const Summary *summary, uint8_t window, uint32_t now, SummaryStats *stats);
+
+#endif /* SUMMARY_H */
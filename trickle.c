@@ -0,0 +1,83 @@
+
+#include "trickle.h"
+#include <stdio.h>
+
+static clock_time_t TrickleInterval(uint8_t doublings)
+{
+	if (doublings > TRICKLE_MAX_DOUBLINGS)
+		doublings = TRICKLE_MAX_DOUBLINGS;
+	return (clock_time_t)TRICKLE_IMIN << doublings;
+}
+
+static void TrickleNewInterval(Trickle *trickle)
+{
+	clock_time_t interval = TrickleInterval(trickle->doublings);
+
+	// transmit point in the second half of the interval
+	trickle->t = interval / 2 + random_rand() % (interval / 2);
+	trickle->before_t = true;
+	trickle->counter = 0;
+}
+
+void TrickleInit(Trickle *trickle)
+{
+	trickle->doublings = 0;
+	trickle->suppressed = 0;
+	TrickleNewInterval(trickle);
+}
+
+bool TrickleReset(Trickle *trickle)
+{
+	if (trickle->doublings == 0)
+		return false;
+
+	printf("Trickle reset, hello interval back to %lu ticks\n", (unsigned long)TRICKLE_IMIN);
+	trickle->doublings = 0;
+	TrickleNewInterval(trickle);
+	return true;
+}
+
+void TrickleConsistent(Trickle *trickle)
+{
+	if (trickle->counter < 255)
+		trickle->counter++;
+}
+
+bool TrickleFire(Trickle *trickle)
+{
+	// end of the interval, double it
+	if (!trickle->before_t) {
+		if (trickle->doublings < TRICKLE_MAX_DOUBLINGS)
+			trickle->doublings++;
+		TrickleNewInterval(trickle);
+		return false;
+	}
+
+	// transmit point
+	trickle->before_t = false;
+	if (trickle->counter >= TRICKLE_K && trickle->suppressed < TRICKLE_MAX_SUPPRESSED) {
+		trickle->suppressed++;
+		printf("Hello suppressed, heard %d consistent ones\n", trickle->counter);
+		return false;
+	}
+	trickle->suppressed = 0;
+	return true;
+}
+
+clock_time_t TrickleNext(Trickle *trickle)
+{
+	if (trickle->before_t)
+		return trickle->t;
+	return TrickleInterval(trickle->doublings) - trickle->t;
+}
+
+clock_time_t TrickleLiveness(Trickle *trickle)
+{
+	clock_time_t liveness = TrickleInterval(trickle->doublings) - trickle->t;
+	uint8_t i;
+
+	// worst case: the hellos of the next intervals are suppressed, lost or sent at the very end
+	for (i = 1; i <= (TRICKLE_MAX_SUPPRESSED + 1) * (TRICKLE_MISSED_HELLOS + 1); i++)
+		liveness += TrickleInterval(trickle->doublings + i);
+	return liveness;
+}
@@ -0,0 +1,50 @@
+/**@file trickle.h*/
+
+#ifndef TRICKLE_H
+#define TRICKLE_H
+
+#include "contiki.h"
+#include "lib/random.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <project-conf.h>
+
+/**@brief Trickle timer for the keep alive (hello) packets.
+ * Intervals start at TRICKLE_IMIN and double up to KEEP_ALIVE_PERIOD while the
+ * neighbourhood is stable. In every interval the hello is sent at a random point in
+ * the second half, unless TRICKLE_K consistent hellos were heard before. At most
+ * TRICKLE_MAX_SUPPRESSED hellos in a row are suppressed, so neighbours can still
+ * tell we are alive. An inconsistency (topology change) starts over at TRICKLE_IMIN.*/
+typedef struct
+{
+	uint8_t doublings;/**<Current interval is TRICKLE_IMIN << doublings.*/
+	clock_time_t t;/**<Transmit point in the current interval.*/
+	bool before_t;/**<True if the next event is the transmit point, false if it is the end of the interval.*/
+	uint8_t counter;/**<Consistent hellos heard in the current interval.*/
+	uint8_t suppressed;/**<Hellos suppressed in a row.*/
+}Trickle;
+
+// starts with the shortest interval
+void TrickleInit(Trickle *trickle);
+
+// starts over with the shortest interval after an inconsistency
+// returns true if the interval changed, the timer has to be set again with TrickleNext()
+bool TrickleReset(Trickle *trickle);
+
+// counts a consistent hello heard from a neighbour
+void TrickleConsistent(Trickle *trickle);
+
+// handles the expiration of the timer set with TrickleNext()
+// returns true if a hello has to be sent now
+bool TrickleFire(Trickle *trickle);
+
+// returns the delay to the next event, from the start of the interval or the transmit point
+clock_time_t TrickleNext(Trickle *trickle);
+
+// returns the longest time from the transmit point until our next hello that can't be suppressed,
+// allowing for TRICKLE_MISSED_HELLOS lost ones
+clock_time_t TrickleLiveness(Trickle *trickle);
+
+#endif /* TRICKLE_H */